@@ -0,0 +1,347 @@
+#include "audio.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <unistd.h>
+#include "mapped_file.h"
+#include "scratch_file.h"
+#include "subprocess.h"
+#include "whisper.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Location of the sample data in a WAV file that is already 16 kHz mono,
+// as 16-bit PCM or 32-bit float; false for anything that needs ffmpeg
+bool find_native_wav_data(const MappedFile& file, size_t& data_offset, size_t& data_size, bool& is_float) {
+    const char* data = file.data();
+    const size_t size = file.size();
+    if (size < 12 || std::memcmp(data, "RIFF", 4) != 0 || std::memcmp(data + 8, "WAVE", 4) != 0) {
+        return false;
+    }
+
+    auto read_u16 = [data](size_t at) { uint16_t v; std::memcpy(&v, data + at, 2); return v; };
+    auto read_u32 = [data](size_t at) { uint32_t v; std::memcpy(&v, data + at, 4); return v; };
+
+    bool native_format = false;
+    size_t pos = 12;
+    while (pos + 8 <= size) {
+        const size_t chunk_size = read_u32(pos + 4);
+        const size_t body = pos + 8;
+
+        if (std::memcmp(data + pos, "fmt ", 4) == 0 && body + 16 <= size) {
+            uint16_t format = read_u16(body);
+            const uint16_t channels = read_u16(body + 2);
+            const uint32_t sample_rate = read_u32(body + 4);
+            const uint16_t bits = read_u16(body + 14);
+            // WAVE_FORMAT_EXTENSIBLE keeps the real format at the start of the sub-format GUID
+            if (format == 0xFFFE && chunk_size >= 40 && body + 26 <= size) {
+                format = read_u16(body + 24);
+            }
+            is_float = format == 3 && bits == 32;
+            native_format = channels == 1 && sample_rate == WHISPER_SAMPLE_RATE &&
+                            ((format == 1 && bits == 16) || is_float);
+        } else if (std::memcmp(data + pos, "data", 4) == 0) {
+            if (!native_format) {
+                return false;
+            }
+            data_offset = body;
+            data_size = std::min(chunk_size, size - body);
+            return true;
+        }
+
+        // Chunks are padded to an even size
+        pos = body + chunk_size + (chunk_size & 1);
+    }
+    return false;
+}
+
+} // namespace
+
+std::vector<float> read_wav_file(const std::string& audio_path) {
+    // Open file in binary mode
+    std::ifstream file(audio_path, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open audio file: " + audio_path);
+    }
+
+    // WAV header structure
+    struct WavHeader {
+        // RIFF header
+        char riff_id[4];        // "RIFF"
+        uint32_t file_size;     // File size - 8
+        char wave_id[4];        // "WAVE"
+
+        // FMT chunk
+        char fmt_id[4];         // "fmt "
+        uint32_t fmt_size;      // Format data length
+        uint16_t format;        // Format type (1 = PCM)
+        uint16_t channels;      // Number of channels
+        uint32_t sample_rate;   // Sample rate
+        uint32_t byte_rate;     // Byte rate
+        uint16_t block_align;   // Block alignment
+        uint16_t bits_per_sample; // Bits per sample
+    };
+
+    // Read the WAV header
+    WavHeader header;
+    file.read(reinterpret_cast<char*>(&header), sizeof(WavHeader));
+
+    // Verify it's a valid WAV file
+    if (strncmp(header.riff_id, "RIFF", 4) != 0 ||
+        strncmp(header.wave_id, "WAVE", 4) != 0 ||
+        strncmp(header.fmt_id, "fmt ", 4) != 0) {
+        throw std::runtime_error("Invalid WAV file format");
+    }
+
+    // Check for the data chunk
+    char chunk_id[4];
+    uint32_t chunk_size;
+
+    // Skip any extra format bytes
+    if (header.fmt_size > 16) {
+        file.seekg(header.fmt_size - 16, std::ios::cur);
+    }
+
+    // Find the data chunk
+    while (true) {
+        if (!file.read(chunk_id, 4)) {
+            throw std::runtime_error("Could not find data chunk in WAV file");
+        }
+
+        file.read(reinterpret_cast<char*>(&chunk_size), 4);
+
+        if (strncmp(chunk_id, "data", 4) == 0) {
+            // Found the data chunk
+            break;
+        }
+
+        // Skip this chunk
+        file.seekg(chunk_size, std::ios::cur);
+    }
+
+    // Calculate number of samples
+    size_t num_samples = chunk_size / (header.bits_per_sample / 8) / header.channels;
+
+    // Validate parameters
+    if (header.bits_per_sample != 16 && header.bits_per_sample != 8 && header.bits_per_sample != 32) {
+        throw std::runtime_error("Unsupported bits per sample: " + std::to_string(header.bits_per_sample));
+    }
+
+    // Read the audio data
+    std::vector<float> samples(num_samples);
+
+    if (header.bits_per_sample == 16) {
+        // 16-bit PCM
+        std::vector<int16_t> buffer(num_samples * header.channels);
+        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels * sizeof(int16_t));
+
+        // Convert to float and handle multiple channels (convert to mono by averaging)
+        for (size_t i = 0; i < num_samples; i++) {
+            float sum = 0.0f;
+            for (uint16_t c = 0; c < header.channels; c++) {
+                sum += buffer[i * header.channels + c] / 32768.0f;  // Normalize to -1.0 to 1.0
+            }
+            samples[i] = sum / header.channels;  // Average all channels
+        }
+    }
+    else if (header.bits_per_sample == 8) {
+        // 8-bit PCM (usually unsigned)
+        std::vector<uint8_t> buffer(num_samples * header.channels);
+        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels);
+
+        // Convert to float and handle multiple channels
+        for (size_t i = 0; i < num_samples; i++) {
+            float sum = 0.0f;
+            for (uint16_t c = 0; c < header.channels; c++) {
+                // 8-bit PCM is usually unsigned (0-255), convert to -1.0 to 1.0
+                sum += (buffer[i * header.channels + c] - 128) / 128.0f;
+            }
+            samples[i] = sum / header.channels;
+        }
+    }
+    else if (header.bits_per_sample == 32) {
+        // 32-bit float
+        std::vector<float> buffer(num_samples * header.channels);
+        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels * sizeof(float));
+
+        // Handle multiple channels
+        for (size_t i = 0; i < num_samples; i++) {
+            float sum = 0.0f;
+            for (uint16_t c = 0; c < header.channels; c++) {
+                sum += buffer[i * header.channels + c];
+            }
+            samples[i] = sum / header.channels;
+        }
+    }
+
+    // Resample if the sample rate is not 16000 Hz
+    // (Note: Proper resampling would require a more sophisticated approach)
+    if (header.sample_rate != 16000) {
+        std::cerr << "Warning: WAV file sample rate is not 16kHz. Audio might not be processed correctly." << std::endl;
+        std::cerr << "Recommend using ffmpeg to convert to 16kHz before processing." << std::endl;
+    }
+
+    return samples;
+}
+
+std::string convert_audio(const std::string& input_path, const std::string& output_path, CancellationToken* cancel,
+                          const std::vector<int>& inherit_fds, double max_seconds, double start_seconds) {
+    std::vector<std::string> args = {"ffmpeg", "-nostdin", "-y"};
+    if (start_seconds > 0.0) {
+        args.insert(args.end(), {"-ss", std::to_string(start_seconds)});
+    }
+    if (max_seconds > 0.0) {
+        args.insert(args.end(), {"-t", std::to_string(max_seconds)});
+    }
+
+    // Use ffmpeg to convert to 16kHz mono WAV (the format is explicit, scratch paths have no extension)
+    args.insert(args.end(), {"-i", input_path, "-ar", "16000", "-ac", "1", "-c:a", "pcm_s16le", "-f", "wav", output_path});
+
+    ProcessResult result = run_process(
+        args,
+        [cancel]() { return cancel != nullptr && cancel->cancelled(); },
+        inherit_fds
+    );
+
+    if (result.cancelled) {
+        throw CancelledError(cancel->reason());
+    }
+    if (result.exit_code != 0) {
+        // The tail of ffmpeg's log carries the actual error
+        const size_t tail = result.output.size() > 500 ? result.output.size() - 500 : 0;
+        throw std::runtime_error("Failed to convert audio: ffmpeg exited with code " + std::to_string(result.exit_code) +
+                                 ": " + result.output.substr(tail));
+    }
+    return output_path;
+}
+
+std::vector<float> decode_upload(const std::string& content, CancellationToken* cancel, double max_seconds) {
+    ScratchFile input("upload");
+    input.write_all(content.data(), content.size());
+    ScratchFile wav("audio.wav");
+
+    if (cancel != nullptr) {
+        cancel->throw_if_cancelled();
+    }
+    convert_audio(input.path(), wav.path(), cancel, {input.fd(), wav.fd()}, max_seconds);
+    return read_wav_file(wav.path());
+}
+
+std::vector<float> load_local_audio(const fs::path& path, double offset_seconds, double duration_seconds,
+                                    CancellationToken* cancel) {
+    MappedFile file(path.string());
+
+    size_t data_offset = 0;
+    size_t data_size = 0;
+    bool is_float = false;
+    if (find_native_wav_data(file, data_offset, data_size, is_float)) {
+        const size_t sample_bytes = is_float ? sizeof(float) : sizeof(int16_t);
+        const size_t total = data_size / sample_bytes;
+        const size_t first = std::min(total, static_cast<size_t>(offset_seconds * WHISPER_SAMPLE_RATE));
+        const size_t count = duration_seconds > 0.0
+            ? std::min(total - first, static_cast<size_t>(duration_seconds * WHISPER_SAMPLE_RATE))
+            : total - first;
+
+        const char* begin = file.data() + data_offset + first * sample_bytes;
+        file.advise_sequential(data_offset + first * sample_bytes, count * sample_bytes);
+
+        std::vector<float> samples(count);
+        for (size_t i = 0; i < count; ++i) {
+            if (is_float) {
+                std::memcpy(&samples[i], begin + i * sizeof(float), sizeof(float));
+            } else {
+                int16_t value;
+                std::memcpy(&value, begin + i * sizeof(int16_t), sizeof(int16_t));
+                samples[i] = value / 32768.0f;
+            }
+        }
+        std::cerr << "Read " << count << " samples directly from " << path.string() << std::endl;
+        return samples;
+    }
+
+    ScratchFile wav("audio.wav");
+    convert_audio(path.string(), wav.path(), cancel, {wav.fd()}, duration_seconds, offset_seconds);
+    return read_wav_file(wav.path());
+}
+
+bool ffmpeg_available() {
+    return run_process({"ffmpeg", "-version"}).exit_code == 0;
+}
+
+AudioStream::Format AudioStream::parse_format(const std::string& name) {
+    if (name == "s16le") return Format::S16le;
+    if (name == "f32le") return Format::F32le;
+    if (name.empty() || name == "auto") return Format::Container;
+    throw std::invalid_argument("Unknown input format: " + name);
+}
+
+AudioStream::AudioStream(int fd, Format format) : fd_(fd), format_(format) {
+    if (format_ == Format::Container) {
+        // ffmpeg reads the container from our descriptor and writes 16-bit PCM into the pipe
+        ffmpeg_ = std::make_unique<ProcessReader>(std::vector<std::string>{
+            "ffmpeg", "-hide_banner", "-loglevel", "error", "-i", "pipe:0",
+            "-ar", "16000", "-ac", "1", "-f", "s16le", "pipe:1"
+        }, fd_);
+    }
+}
+
+AudioStream::~AudioStream() = default;
+
+size_t AudioStream::read_bytes(char* buffer, size_t size) {
+    if (ffmpeg_) {
+        return ffmpeg_->read(buffer, size);
+    }
+    while (true) {
+        ssize_t n = ::read(fd_, buffer, size);
+        if (n >= 0) {
+            return static_cast<size_t>(n);
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("Failed to read input: ") + std::strerror(errno));
+        }
+    }
+}
+
+bool AudioStream::read(std::vector<float>& out, size_t count) {
+    const size_t sample_bytes = format_ == Format::F32le ? sizeof(float) : sizeof(int16_t);
+    char buffer[16384];
+
+    size_t appended = 0;
+    while (appended < count && !ended_) {
+        const size_t wanted = std::min(sizeof(buffer), (count - appended) * sample_bytes - partial_.size());
+        const size_t n = read_bytes(buffer, wanted);
+        if (n == 0) {
+            ended_ = true;
+            if (ffmpeg_) {
+                const int exit_code = ffmpeg_->wait();
+                if (exit_code != 0) {
+                    throw std::runtime_error("Failed to decode input: ffmpeg exited with code " + std::to_string(exit_code));
+                }
+            }
+            break;
+        }
+
+        partial_.append(buffer, n);
+        const size_t samples = partial_.size() / sample_bytes;
+        for (size_t i = 0; i < samples; ++i) {
+            if (format_ == Format::F32le) {
+                float value;
+                std::memcpy(&value, partial_.data() + i * sample_bytes, sizeof(float));
+                out.push_back(value);
+            } else {
+                int16_t value;
+                std::memcpy(&value, partial_.data() + i * sample_bytes, sizeof(int16_t));
+                out.push_back(value / 32768.0f);
+            }
+        }
+        partial_.erase(0, samples * sample_bytes);
+        appended += samples;
+    }
+    return !ended_;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cancellation.h"
+#include "subprocess.h"
+
+// Read a PCM (8/16-bit) or 32-bit float WAV file into mono samples, averaging the channels
+std::vector<float> read_wav_file(const std::string& audio_path);
+
+// Convert audio to the format Whisper expects (16 kHz mono 16-bit WAV) using ffmpeg.
+// The ffmpeg child is killed as soon as the request is cancelled; inherit_fds keeps
+// scratch files reachable through their /proc/self/fd paths.
+// A positive max_seconds makes ffmpeg stop decoding the input after that much audio;
+// a positive start_seconds seeks in the input before decoding.
+std::string convert_audio(const std::string& input_path, const std::string& output_path, CancellationToken* cancel = nullptr,
+                          const std::vector<int>& inherit_fds = {}, double max_seconds = 0.0, double start_seconds = 0.0);
+
+// Decode an uploaded file into 16 kHz mono samples through scratch files.
+// Scratch files are unnamed and go away on return, on success and error paths alike.
+std::vector<float> decode_upload(const std::string& content, CancellationToken* cancel = nullptr, double max_seconds = 0.0);
+
+// Decode [offset, offset + duration) of a local file; a zero duration means to the end.
+// 16 kHz mono WAVs are converted straight out of a memory mapping, so only the requested
+// range is ever paged in. Anything else is handed to ffmpeg by path, which seeks in the
+// file itself; only the decoded range lands in a scratch file.
+std::vector<float> load_local_audio(const std::filesystem::path& path, double offset_seconds, double duration_seconds,
+                                    CancellationToken* cancel = nullptr);
+
+// Whether ffmpeg can be run
+bool ffmpeg_available();
+
+// 16 kHz mono samples read incrementally from a descriptor (a pipe, typically stdin):
+// raw little-endian PCM as is, or any container ffmpeg can stream through its stdin.
+// Only what the caller asks for is buffered, however long the input is.
+class AudioStream {
+public:
+    enum class Format {
+        S16le,     // 16-bit signed PCM
+        F32le,     // 32-bit float PCM
+        Container  // anything else, decoded by an ffmpeg child
+    };
+
+    // Throws std::invalid_argument for unknown names: s16le, f32le, or auto for Container
+    static Format parse_format(const std::string& name);
+
+    AudioStream(int fd, Format format);
+    ~AudioStream();
+    AudioStream(const AudioStream&) = delete;
+    AudioStream& operator=(const AudioStream&) = delete;
+
+    // Append up to count samples to out, blocking until they are there or the input ends.
+    // False once the input has ended (the last samples may still have been appended).
+    // Throws std::runtime_error when ffmpeg fails on the input.
+    bool read(std::vector<float>& out, size_t count);
+
+private:
+    size_t read_bytes(char* buffer, size_t size);
+
+    int fd_;
+    Format format_;
+    std::unique_ptr<ProcessReader> ffmpeg_;
+    std::string partial_; // bytes of a sample split across reads
+    bool ended_ = false;
+};
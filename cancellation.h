@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+enum class CancelReason {
+    None = 0,
+    ClientDisconnected = 1,
+    Timeout = 2,
+    Shutdown = 3
+};
+
+inline const char* cancel_reason_name(CancelReason reason) {
+    switch (reason) {
+        case CancelReason::ClientDisconnected: return "clientDisconnected";
+        case CancelReason::Timeout: return "timeout";
+        case CancelReason::Shutdown: return "shutdown";
+        case CancelReason::None: break;
+    }
+    return "none";
+}
+
+// Raised when a request is abandoned part way through
+class CancelledError : public std::runtime_error {
+public:
+    explicit CancelledError(CancelReason reason)
+        : std::runtime_error(std::string("Request cancelled: ") + cancel_reason_name(reason)), reason(reason) {}
+
+    CancelReason reason;
+};
+
+// Tracks whether a request is still worth finishing: the client may have gone away, the
+// request may have run past its timeout, or the server may be shutting down. Polled from
+// the handler thread, the ffmpeg wait loop and whisper's abort callback, so checks are
+// cheap and the result is sticky.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // shutdown, when given, is a process-wide flag raised once a drain runs out of time
+    CancellationToken(std::function<bool()> connection_closed, Clock::time_point timeout,
+                      const std::atomic<bool>* shutdown = nullptr)
+        : connection_closed_(std::move(connection_closed)), timeout_(timeout), shutdown_(shutdown) {}
+
+    bool cancelled() {
+        if (reason_.load(std::memory_order_relaxed) != static_cast<int>(CancelReason::None)) {
+            return true;
+        }
+
+        if (shutdown_ != nullptr && shutdown_->load(std::memory_order_relaxed)) {
+            cancel(CancelReason::Shutdown);
+            return true;
+        }
+
+        const auto now = Clock::now();
+        if (now >= timeout_) {
+            cancel(CancelReason::Timeout);
+            return true;
+        }
+
+        // whisper calls the abort callback very often; only probe the socket every so often
+        const int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        int64_t last = last_probe_ms_.load(std::memory_order_relaxed);
+        if (now_ms - last >= PROBE_INTERVAL_MS && last_probe_ms_.compare_exchange_strong(last, now_ms)) {
+            if (connection_closed_ && connection_closed_()) {
+                cancel(CancelReason::ClientDisconnected);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void cancel(CancelReason reason) {
+        int expected = static_cast<int>(CancelReason::None);
+        reason_.compare_exchange_strong(expected, static_cast<int>(reason));
+    }
+
+    CancelReason reason() const {
+        return static_cast<CancelReason>(reason_.load());
+    }
+
+    void throw_if_cancelled() {
+        if (cancelled()) {
+            throw CancelledError(reason());
+        }
+    }
+
+private:
+    static constexpr int64_t PROBE_INTERVAL_MS = 100;
+
+    std::function<bool()> connection_closed_;
+    Clock::time_point timeout_;
+    const std::atomic<bool>* shutdown_;
+    std::atomic<int> reason_{static_cast<int>(CancelReason::None)};
+    std::atomic<int64_t> last_probe_ms_{0};
+};
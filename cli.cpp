@@ -3,243 +3,103 @@
 #include <vector>
 #include <string>
 #include <filesystem>
-#include "whisper.h"
+#include <cstdlib>
+#include <unistd.h>
 #include "nlohmann/json.hpp"
+#include "audio.h"
+#include "engine.h"
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
-// These functions should match those in main.cpp
-// You could also extract these to separate files to avoid duplication
-std::vector<float> read_wav_file(const std::string& audio_path) {
-    // Open file in binary mode
-    std::ifstream file(audio_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open audio file: " + audio_path);
-    }
+// Transcribe a stream in rolling windows, writing each segment as an NDJSON line as soon as
+// it is decoded. The last segment of a window may be cut off by the window boundary, so
+// unless the input has ended it is not written: its audio is carried into the next window
+// and decoded again there. Memory stays at one window of samples for any input length.
+void transcribe_stream(WhisperEngine& engine, AudioStream& stream, const TranscribeOptions& base_options,
+                       double window_seconds, std::ostream& out) {
+    const size_t window = static_cast<size_t>(window_seconds * WHISPER_SAMPLE_RATE);
+    const size_t max_carry = window / 2;
 
-    // WAV header structure
-    struct WavHeader {
-        // RIFF header
-        char riff_id[4];        // "RIFF"
-        uint32_t file_size;     // File size - 8
-        char wave_id[4];        // "WAVE"
+    std::vector<float> samples;
+    samples.reserve(window);
+    double window_start = 0.0; // position of samples[0] in the input, in seconds
 
-        // FMT chunk
-        char fmt_id[4];         // "fmt "
-        uint32_t fmt_size;      // Format data length
-        uint16_t format;        // Format type (1 = PCM)
-        uint16_t channels;      // Number of channels
-        uint32_t sample_rate;   // Sample rate
-        uint32_t byte_rate;     // Byte rate
-        uint16_t block_align;   // Block alignment
-        uint16_t bits_per_sample; // Bits per sample
+    auto emit = [&out, &window_start](json segment) {
+        segment["timeStart"] = window_start + segment["timeStart"].get<double>();
+        segment["timeEnd"] = window_start + segment["timeEnd"].get<double>();
+        out << segment.dump(-1, ' ', false, json::error_handler_t::replace) << std::endl;
     };
 
-    // Read the WAV header
-    WavHeader header;
-    file.read(reinterpret_cast<char*>(&header), sizeof(WavHeader));
-
-    // Verify it's a valid WAV file
-    if (strncmp(header.riff_id, "RIFF", 4) != 0 ||
-        strncmp(header.wave_id, "WAVE", 4) != 0 ||
-        strncmp(header.fmt_id, "fmt ", 4) != 0) {
-        throw std::runtime_error("Invalid WAV file format");
-    }
-
-    // Check for the data chunk
-    char chunk_id[4];
-    uint32_t chunk_size;
-
-    // Skip any extra format bytes
-    if (header.fmt_size > 16) {
-        file.seekg(header.fmt_size - 16, std::ios::cur);
-    }
-
-    // Find the data chunk
+    bool more = true;
     while (true) {
-        if (!file.read(chunk_id, 4)) {
-            throw std::runtime_error("Could not find data chunk in WAV file");
+        if (more) {
+            more = stream.read(samples, window - samples.size());
         }
-
-        file.read(reinterpret_cast<char*>(&chunk_size), 4);
-
-        if (strncmp(chunk_id, "data", 4) == 0) {
-            // Found the data chunk
+        if (samples.empty()) {
             break;
         }
 
-        // Skip this chunk
-        file.seekg(chunk_size, std::ios::cur);
-    }
-
-    // Calculate number of samples
-    size_t num_samples = chunk_size / (header.bits_per_sample / 8) / header.channels;
-
-    // Validate parameters
-    if (header.bits_per_sample != 16 && header.bits_per_sample != 8 && header.bits_per_sample != 32) {
-        throw std::runtime_error("Unsupported bits per sample: " + std::to_string(header.bits_per_sample));
-    }
-
-    std::cout << "WAV file details: " << std::endl;
-    std::cout << "  Channels: " << header.channels << std::endl;
-    std::cout << "  Sample rate: " << header.sample_rate << std::endl;
-    std::cout << "  Bits per sample: " << header.bits_per_sample << std::endl;
-    std::cout << "  Number of samples: " << num_samples << std::endl;
-
-    // Read the audio data
-    std::vector<float> samples(num_samples);
-
-    if (header.bits_per_sample == 16) {
-        // 16-bit PCM
-        std::vector<int16_t> buffer(num_samples * header.channels);
-        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels * sizeof(int16_t));
-
-        // Convert to float and handle multiple channels (convert to mono by averaging)
-        for (size_t i = 0; i < num_samples; i++) {
-            float sum = 0.0f;
-            for (uint16_t c = 0; c < header.channels; c++) {
-                sum += buffer[i * header.channels + c] / 32768.0f;  // Normalize to -1.0 to 1.0
+        // Segments are written one behind, so the window's last one can still be held back
+        json pending;
+        TranscribeOptions options = base_options;
+        options.on_segment = [&](const json& segment) {
+            if (!pending.is_null()) {
+                emit(pending);
             }
-            samples[i] = sum / header.channels;  // Average all channels
-        }
-    }
-    else if (header.bits_per_sample == 8) {
-        // 8-bit PCM (usually unsigned)
-        std::vector<uint8_t> buffer(num_samples * header.channels);
-        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels);
-
-        // Convert to float and handle multiple channels
-        for (size_t i = 0; i < num_samples; i++) {
-            float sum = 0.0f;
-            for (uint16_t c = 0; c < header.channels; c++) {
-                // 8-bit PCM is usually unsigned (0-255), convert to -1.0 to 1.0
-                sum += (buffer[i * header.channels + c] - 128) / 128.0f;
-            }
-            samples[i] = sum / header.channels;
-        }
-    }
-    else if (header.bits_per_sample == 32) {
-        // 32-bit float
-        std::vector<float> buffer(num_samples * header.channels);
-        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels * sizeof(float));
-
-        // Handle multiple channels
-        for (size_t i = 0; i < num_samples; i++) {
-            float sum = 0.0f;
-            for (uint16_t c = 0; c < header.channels; c++) {
-                sum += buffer[i * header.channels + c];
+            pending = segment;
+        };
+        engine.transcribe(samples, options);
+
+        size_t consumed = samples.size();
+        if (!pending.is_null()) {
+            const size_t start = static_cast<size_t>(pending["timeStart"].get<double>() * WHISPER_SAMPLE_RATE);
+            if (more && start > 0 && start < samples.size() && samples.size() - start <= max_carry) {
+                consumed = start;
+            } else {
+                emit(pending);
             }
-            samples[i] = sum / header.channels;
         }
-    }
-
-    // Resample if the sample rate is not 16000 Hz
-    // (Note: Proper resampling would require a more sophisticated approach)
-    if (header.sample_rate != 16000) {
-        std::cout << "Warning: WAV file sample rate is not 16kHz. Audio might not be processed correctly." << std::endl;
-        std::cout << "Recommend using ffmpeg to convert to 16kHz before processing." << std::endl;
-    }
-
-    return samples;
-}
-
-json transcribe_audio(const std::string& audio_path) {
-    // Initialize whisper parameters
-    whisper_context_params params = whisper_context_default_params();
-
-    // Initialize whisper context with params
-    struct whisper_context* ctx = whisper_init_from_file_with_params("models/ggml-base.en.bin", params);
-    if (ctx == nullptr) {
-        throw std::runtime_error("Failed to initialize whisper context");
-    }
-
-    // Set full parameters
-    whisper_full_params full_params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-    full_params.print_realtime = false;
-    full_params.print_progress = true;
-    full_params.translate = false;
-    full_params.language = "en";
-    full_params.n_threads = 4;
-    full_params.offset_ms = 0;
-
-    // Read audio samples
-    std::vector<float> samples;
-    try {
-        samples = read_wav_file(audio_path);
-    } catch (const std::exception& e) {
-        whisper_free(ctx);
-        throw std::runtime_error(std::string("Failed to read audio: ") + e.what());
-    }
 
-    // Process the audio file
-    if (whisper_full(ctx, full_params, samples.data(), samples.size()) != 0) {
-        whisper_free(ctx);
-        throw std::runtime_error("Failed to process audio");
+        samples.erase(samples.begin(), samples.begin() + consumed);
+        window_start += static_cast<double>(consumed) / WHISPER_SAMPLE_RATE;
     }
-
-    // Create JSON response
-    json result = json::array();
-
-    // Get the number of segments
-    const int n_segments = whisper_full_n_segments(ctx);
-
-    for (int i = 0; i < n_segments; ++i) {
-        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-
-        // Convert timestamps to seconds
-        double time_start = t0 / 100.0;
-        double time_end = t1 / 100.0;
-
-        const char* text = whisper_full_get_segment_text(ctx, i);
-
-        json segment = {
-            {"timeStart", time_start},
-            {"timeEnd", time_end},
-            {"text", std::string(text)}
-        };
-
-        result.push_back(segment);
-    }
-
-    whisper_free(ctx);
-    return result;
 }
 
-
-std::string exec_command(const std::string& cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
-    }
-    return result;
-}
-
-
-std::string convert_audio(const std::string& input_path, const std::string& output_path) {
-    // Use ffmpeg to convert to 16kHz mono WAV
-    std::string cmd = "ffmpeg -y -i \"" + input_path + "\" -ar 16000 -ac 1 -c:a pcm_s16le \"" + output_path + "\" 2>&1";
-
-    try {
-        std::string output = exec_command(cmd);
-        return output_path;
-    } catch (const std::exception& e) {
-        throw std::runtime_error(std::string("Failed to convert audio: ") + e.what());
+int main(int argc, char** argv) {
+    std::vector<std::string> positional;
+    std::string format = "auto";
+    std::string profile;
+    std::string language;
+    double window_seconds = WHISPER_CHUNK_SIZE;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if ((arg == "--format" || arg == "--profile" || arg == "--language" || arg == "--window") && i + 1 < argc) {
+            const std::string value = argv[++i];
+            if (arg == "--format") format = value;
+            else if (arg == "--profile") profile = value;
+            else if (arg == "--language") language = value;
+            else window_seconds = std::atof(value.c_str());
+        } else {
+            positional.push_back(arg);
+        }
     }
-}
 
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <audio_file> [output_file]" << std::endl;
+    if (positional.empty() || window_seconds <= 0.0) {
+        std::cerr << "Usage: " << argv[0] << " <audio_file> [output_file] [--profile NAME] [--language LANG]" << std::endl;
+        std::cerr << "       " << argv[0] << " - [--format auto|s16le|f32le] [--window SECONDS] [--profile NAME] [--language LANG]" << std::endl;
         std::cerr << "  If output_file is not specified, output is printed to stdout" << std::endl;
+        std::cerr << "  With -, audio is read from stdin (16 kHz mono for s16le/f32le, any container with auto)" << std::endl;
+        std::cerr << "  and each segment is printed as an NDJSON line as soon as it is decoded" << std::endl;
         return 1;
     }
+    const bool streaming = positional[0] == "-";
+
+    // In streaming mode stdout carries only NDJSON; diagnostics go to stderr
+    std::ostream ndjson(std::cout.rdbuf());
+    if (streaming) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
 
     // Check if model exists
     if (!fs::exists("models/ggml-base.en.bin")) {
@@ -249,50 +109,64 @@ int main(int argc, char** argv) {
         return 1;
     }
 
-    // Check if ffmpeg is installed
+    AudioStream::Format stream_format = AudioStream::Format::Container;
     try {
-        exec_command("ffmpeg -version");
-    } catch (const std::exception&) {
+        stream_format = AudioStream::parse_format(format);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    // Check if ffmpeg is installed (raw PCM on stdin doesn't need it)
+    if ((!streaming || stream_format == AudioStream::Format::Container) && !ffmpeg_available()) {
         std::cerr << "Error: ffmpeg not found. Audio conversion will not work." << std::endl;
         std::cerr << "Please install ffmpeg to enable audio file processing." << std::endl;
         return 1;
     }
 
-    std::string audio_path = argv[1];
-    std::cout << "Transcribing file: " << audio_path << std::endl;
+    std::string audio_path = positional[0];
+    std::cout << "Transcribing " << (streaming ? std::string("stdin") : "file: " + audio_path) << std::endl;
 
     try {
-        std::string temp_path = "/tmp/audio_" + std::to_string(time(nullptr));
-        std::string wav_path = temp_path + ".wav";
+        // Same engine as the service; one-shot runs skip the warm-up and keep 4 threads
+        WhisperEngine::Config config;
+        config.n_threads = 4;
+        config.warm_up = false;
+        WhisperEngine engine(config);
+        engine.set_model(engine.load_model());
+
+        TranscribeOptions options = engine.options(profile);
+        if (!language.empty()) {
+            options.language = language;
+        }
 
-        // Convert audio to WAV format
-        std::cout << "Converting audio..." << std::endl;
-        convert_audio(audio_path, wav_path);
+        if (streaming) {
+            AudioStream stream(STDIN_FILENO, stream_format);
+            transcribe_stream(engine, stream, options, window_seconds, ndjson);
+            return 0;
+        }
 
-        // Transcribe audio
+        // 16 kHz mono WAVs are read directly, anything else is converted by ffmpeg first
         std::cout << "Transcribing audio..." << std::endl;
-        json result = transcribe_audio(wav_path);
+        json result = engine.transcribe_file(audio_path, options)["segments"];
 
         // Output the result
-        if (argc > 2) {
+        if (positional.size() > 1) {
             // Write to specified output file
-            std::string output_file = argv[2];
+            std::string output_file = positional[1];
             std::ofstream out(output_file);
             if (!out.is_open()) {
                 std::cerr << "Error: Could not open output file: " << output_file << std::endl;
                 return 1;
             }
-            out << result.dump(2);
+            out << result.dump(2, ' ', false, json::error_handler_t::replace);
             out.close();
             std::cout << "Transcription saved to: " << output_file << std::endl;
         } else {
             // Print to stdout
-            std::cout << result.dump(2) << std::endl;
+            std::cout << result.dump(2, ' ', false, json::error_handler_t::replace) << std::endl;
         }
 
-        // Clean up temporary files
-        std::remove(wav_path.c_str());
-
         return 0;
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
@@ -0,0 +1,140 @@
+#include "context_profiles.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+// whisper_tokenize wrapper that grows the buffer when the text is longer than expected
+std::vector<whisper_token> tokenize_text(struct whisper_context* ctx, const std::string& text) {
+    std::vector<whisper_token> tokens(text.size() + 8);
+    int n = whisper_tokenize(ctx, text.c_str(), tokens.data(), static_cast<int>(tokens.size()));
+    if (n < 0) {
+        tokens.resize(static_cast<size_t>(-n));
+        n = whisper_tokenize(ctx, text.c_str(), tokens.data(), static_cast<int>(tokens.size()));
+    }
+    tokens.resize(std::max(n, 0));
+    return tokens;
+}
+
+void bias_logits(struct whisper_context* ctx, struct whisper_state*, const whisper_token_data*, int, float* logits, void* user_data) {
+    const auto* context = static_cast<const TenantContext*>(user_data);
+    const int n_vocab = whisper_n_vocab(ctx);
+    for (whisper_token token : context->bias_tokens) {
+        // Ids from another vocabulary would write outside the logits
+        if (token >= 0 && token < n_vocab) {
+            logits[token] += context->bias;
+        }
+    }
+}
+
+} // namespace
+
+ContextProfiles::ContextProfiles(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return;
+    }
+
+    try {
+        json config = json::parse(file);
+        for (auto it = config.begin(); it != config.end(); ++it) {
+            Profile profile;
+            profile.prompt = it.value().value("prompt", "");
+            profile.vocabulary = it.value().value("vocabulary", std::vector<std::string>());
+            profile.bias = it.value().value("bias", 0.0f);
+            profiles_[it.key()] = profile;
+        }
+        std::cerr << "Loaded " << profiles_.size() << " context profiles from " << path << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: ignoring context profiles in " << path << ": " << e.what() << std::endl;
+        profiles_.clear();
+    }
+}
+
+std::shared_ptr<const TenantContext> ContextProfiles::get(const WhisperModel& model, const std::string& tenant) {
+    auto profile = profiles_.find(tenant);
+    if (tenant.empty() || profile == profiles_.end()) {
+        return nullptr;
+    }
+
+    // Token ids depend on the model's vocabulary, so the cache is per model generation:
+    // a reload can put a model with another vocabulary at the same path
+    const auto key = std::make_pair(model.generation(), tenant);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cached = cache_.find(key);
+        if (cached != cache_.end()) {
+            return cached->second;
+        }
+    }
+
+    auto context = tokenize(model.context(), tenant, profile->second);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    return cache_.emplace(key, context).first->second;
+}
+
+void ContextProfiles::clear_cache() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cache_.clear();
+}
+
+std::shared_ptr<const TenantContext> ContextProfiles::tokenize(struct whisper_context* ctx, const std::string& tenant, const Profile& profile) const {
+    auto context = std::make_shared<TenantContext>();
+    context->tenant = tenant;
+    context->bias = profile.bias;
+
+    // The vocabulary goes into the prompt as well, which is what conditions the decoder most
+    std::string prompt = profile.prompt;
+    if (!profile.vocabulary.empty()) {
+        std::string glossary;
+        for (const auto& term : profile.vocabulary) {
+            glossary += (glossary.empty() ? "" : ", ") + term;
+        }
+        prompt += (prompt.empty() ? "" : " ") + glossary + ".";
+    }
+    context->prompt_tokens = tokenize_text(ctx, prompt);
+
+    // whisper only looks at the last n_text_ctx/2 prompt tokens; drop the rest up front
+    const size_t max_prompt = static_cast<size_t>(whisper_n_text_ctx(ctx) / 2);
+    if (context->prompt_tokens.size() > max_prompt) {
+        context->prompt_tokens.erase(context->prompt_tokens.begin(),
+                                     context->prompt_tokens.end() - max_prompt);
+    }
+
+    // Terms can start a sentence or follow a space, which tokenize differently
+    if (profile.bias != 0.0f) {
+        for (const auto& term : profile.vocabulary) {
+            for (const std::string& variant : {term, " " + term}) {
+                auto tokens = tokenize_text(ctx, variant);
+                if (!tokens.empty() &&
+                    std::find(context->bias_tokens.begin(), context->bias_tokens.end(), tokens[0]) == context->bias_tokens.end()) {
+                    context->bias_tokens.push_back(tokens[0]);
+                }
+            }
+        }
+    }
+
+    return context;
+}
+
+void apply_tenant_context(whisper_full_params& params, const TenantContext* context) {
+    if (context == nullptr) {
+        return;
+    }
+
+    if (!context->prompt_tokens.empty()) {
+        params.prompt_tokens = context->prompt_tokens.data();
+        params.prompt_n_tokens = static_cast<int>(context->prompt_tokens.size());
+    }
+
+    if (!context->bias_tokens.empty()) {
+        params.logits_filter_callback = bias_logits;
+        params.logits_filter_callback_user_data = const_cast<TenantContext*>(context);
+    }
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include "whisper.h"
+#include "whisper_model.h"
+
+// Decoder context of one tenant, tokenized for one model
+struct TenantContext {
+    std::string tenant;
+    std::vector<whisper_token> prompt_tokens;   // passed as whisper's initial prompt
+    std::vector<whisper_token> bias_tokens;     // first token of every vocabulary term
+    float bias = 0.0f;                          // logit boost applied to bias_tokens
+};
+
+// Per-tenant context profiles (initial prompt + domain vocabulary) loaded from a JSON file:
+//
+//   { "medical": { "prompt": "Clinical dictation.", "vocabulary": ["metoprolol"], "bias": 1.0 } }
+//
+// Profiles are tokenized once per model generation and reused by every request of the
+// tenant, instead of having whisper re-tokenize an initial_prompt string on each call.
+class ContextProfiles {
+public:
+    // A missing file just means no profiles
+    explicit ContextProfiles(const std::string& path);
+
+    // nullptr when the tenant has no profile
+    std::shared_ptr<const TenantContext> get(const WhisperModel& model, const std::string& tenant);
+
+    // Drop the cached contexts, e.g. once a new model generation is published; contexts
+    // already handed out stay valid for the requests holding them
+    void clear_cache();
+
+    size_t size() const { return profiles_.size(); }
+
+private:
+    struct Profile {
+        std::string prompt;
+        std::vector<std::string> vocabulary;
+        float bias = 0.0f;
+    };
+
+    std::shared_ptr<const TenantContext> tokenize(struct whisper_context* ctx, const std::string& tenant, const Profile& profile) const;
+
+    std::map<std::string, Profile> profiles_;
+
+    std::mutex mutex_;
+    std::map<std::pair<uint64_t, std::string>, std::shared_ptr<const TenantContext>> cache_; // (generation, tenant)
+};
+
+// Hook the tenant context into whisper_full's parameters. The context must outlive the call.
+void apply_tenant_context(whisper_full_params& params, const TenantContext* context);
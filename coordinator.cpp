@@ -0,0 +1,433 @@
+#include "coordinator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include "httplib.h"
+#include "whisper.h"
+
+using json = nlohmann::json;
+
+struct ShardCoordinator::Stats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> chunks{0};
+    std::atomic<uint64_t> retries{0};
+    std::atomic<uint64_t> hedges{0};
+    std::atomic<uint64_t> hedge_wins{0};
+    std::atomic<uint64_t> failures{0};
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// One chunk of a sharded request. wav and audio_seconds never change after setup,
+// so request threads read them without the lock.
+struct ChunkWork {
+    std::string wav;
+    double offset_seconds = 0.0;
+    double audio_seconds = 0.0;
+
+    bool done = false;
+    json result;
+    int attempts = 0;
+    bool hedged = false;
+    size_t hedge_worker = std::numeric_limits<size_t>::max();
+    std::set<size_t> running_on;
+    std::set<size_t> failed_on;
+    Clock::time_point started;
+    double latency = 0.0;
+    size_t winner = 0;
+    std::string last_error;
+};
+
+struct Dispatch {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<ChunkWork> chunks;
+    std::vector<int> busy;
+    std::string rejected; // a worker refused the request itself; retrying won't help
+
+    // Requests in flight by (chunk, worker), so they can be stopped once their answer is no
+    // longer needed; set once transcribe() has returned or thrown
+    std::map<std::pair<size_t, size_t>, httplib::Client*> clients;
+    std::atomic<bool> abandoned{false};
+};
+
+// Stop the requests of a chunk that are still running on workers other than keep
+// (all of them by default), so the workers drop the work
+void stop_requests_locked(Dispatch& dispatch, size_t chunk, size_t keep = std::numeric_limits<size_t>::max()) {
+    for (auto& [key, client] : dispatch.clients) {
+        if (key.first == chunk && key.second != keep) {
+            client->stop();
+        }
+    }
+}
+
+// Abandons the dispatch when transcribe() leaves, whether with the stitched result or an
+// exception: requests still in flight (losing hedges, the other chunks of a failed request)
+// are stopped instead of being left to transcribe the rest of the file
+class AbandonOnExit {
+public:
+    explicit AbandonOnExit(Dispatch& dispatch) : dispatch_(dispatch) {}
+    ~AbandonOnExit() {
+        dispatch_.abandoned = true;
+        for (auto& [key, client] : dispatch_.clients) {
+            client->stop();
+        }
+    }
+    AbandonOnExit(const AbandonOnExit&) = delete;
+    AbandonOnExit& operator=(const AbandonOnExit&) = delete;
+
+private:
+    Dispatch& dispatch_;
+};
+
+// First idle worker that hasn't failed this chunk and isn't already running it
+// (a worker that failed it is still acceptable when there is no other choice)
+size_t pick_worker(const Dispatch& dispatch, const ChunkWork& chunk) {
+    size_t fallback = std::numeric_limits<size_t>::max();
+    for (size_t w = 0; w < dispatch.busy.size(); ++w) {
+        if (dispatch.busy[w] > 0 || chunk.running_on.count(w) > 0) {
+            continue;
+        }
+        if (chunk.failed_on.count(w) == 0) {
+            return w;
+        }
+        fallback = std::min(fallback, w);
+    }
+    return fallback;
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) return 0.0;
+    std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+    return values[values.size() / 2];
+}
+
+// Append one chunk's columnar word/token timings, shifted onto the full recording
+void append_columns(json& merged, const json& columns, double offset_seconds, size_t segment_base) {
+    for (auto it = columns.begin(); it != columns.end(); ++it) {
+        json& target = merged[it.key()];
+        if (target.is_null()) {
+            target = json::array();
+        }
+        for (const auto& value : it.value()) {
+            if (it.key() == "start" || it.key() == "end") {
+                target.push_back(value.get<double>() + offset_seconds);
+            } else if (it.key() == "segment") {
+                target.push_back(value.get<size_t>() + segment_base);
+            } else {
+                target.push_back(value);
+            }
+        }
+    }
+}
+
+} // namespace
+
+std::vector<AudioChunk> split_at_silence(const std::vector<float>& samples, double target_seconds, double search_seconds) {
+    const size_t target = static_cast<size_t>(target_seconds * WHISPER_SAMPLE_RATE);
+    const size_t search = std::min(target / 2, static_cast<size_t>(search_seconds * WHISPER_SAMPLE_RATE));
+    const size_t frame = WHISPER_SAMPLE_RATE / 50;
+
+    std::vector<AudioChunk> chunks;
+    size_t begin = 0;
+    while (target > 0 && samples.size() - begin > target + search) {
+        size_t cut = begin + target;
+        double quietest = std::numeric_limits<double>::max();
+        for (size_t f = begin + target - search; f + frame <= begin + target + search; f += frame) {
+            double energy = 0.0;
+            for (size_t i = f; i < f + frame; ++i) {
+                energy += samples[i] * samples[i];
+            }
+            if (energy < quietest) {
+                quietest = energy;
+                cut = f + frame / 2;
+            }
+        }
+        chunks.push_back({begin, cut});
+        begin = cut;
+    }
+    chunks.push_back({begin, samples.size()});
+    return chunks;
+}
+
+std::string encode_wav(const float* samples, size_t count) {
+    const uint32_t data_size = static_cast<uint32_t>(count * sizeof(int16_t));
+    const uint32_t riff_size = 36 + data_size;
+    const uint32_t fmt_size = 16;
+    const uint16_t format = 1;
+    const uint16_t channels = 1;
+    const uint32_t sample_rate = WHISPER_SAMPLE_RATE;
+    const uint32_t byte_rate = sample_rate * sizeof(int16_t);
+    const uint16_t block_align = sizeof(int16_t);
+    const uint16_t bits = 16;
+
+    std::string wav(44 + data_size, '\0');
+    char* out = &wav[0];
+    auto put = [&out](const void* value, size_t size) {
+        std::memcpy(out, value, size);
+        out += size;
+    };
+    put("RIFF", 4); put(&riff_size, 4); put("WAVE", 4);
+    put("fmt ", 4); put(&fmt_size, 4); put(&format, 2); put(&channels, 2);
+    put(&sample_rate, 4); put(&byte_rate, 4); put(&block_align, 2); put(&bits, 2);
+    put("data", 4); put(&data_size, 4);
+
+    for (size_t i = 0; i < count; ++i) {
+        const float clamped = std::max(-1.0f, std::min(1.0f, samples[i]));
+        const int16_t value = static_cast<int16_t>(clamped * 32767.0f);
+        put(&value, 2);
+    }
+    return wav;
+}
+
+std::vector<std::string> parse_worker_list(const std::string& value) {
+    std::vector<std::string> workers;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        std::string worker = value.substr(start, end - start);
+        worker.erase(0, worker.find_first_not_of(" \t"));
+        worker.erase(worker.find_last_not_of(" \t/") + 1);
+        if (!worker.empty()) {
+            workers.push_back(worker);
+        }
+        start = end + 1;
+    }
+    return workers;
+}
+
+ShardCoordinator::ShardCoordinator(std::vector<std::string> workers, Options options)
+    : workers_(std::move(workers)), options_(options), stats_(std::make_shared<Stats>()) {}
+
+json ShardCoordinator::transcribe(const std::vector<float>& samples,
+                                  const std::vector<std::pair<std::string, std::string>>& fields,
+                                  CancellationToken* cancel) {
+    if (workers_.empty()) {
+        throw std::runtime_error("No workers configured");
+    }
+    stats_->requests++;
+
+    auto dispatch = std::make_shared<Dispatch>();
+    dispatch->busy.assign(workers_.size(), 0);
+    for (const AudioChunk& range : split_at_silence(samples, options_.chunk_seconds, options_.search_seconds)) {
+        ChunkWork chunk;
+        chunk.wav = encode_wav(samples.data() + range.begin, range.end - range.begin);
+        chunk.offset_seconds = range.begin / static_cast<double>(WHISPER_SAMPLE_RATE);
+        chunk.audio_seconds = (range.end - range.begin) / static_cast<double>(WHISPER_SAMPLE_RATE);
+        dispatch->chunks.push_back(std::move(chunk));
+    }
+    stats_->chunks += dispatch->chunks.size();
+
+    httplib::MultipartFormDataItems base_items;
+    for (const auto& [name, value] : fields) {
+        base_items.push_back({name, value, "", ""});
+    }
+
+    // Runs on its own thread; holds the dispatch alive, since a losing hedge can finish late
+    auto launch = [&](size_t index, size_t worker) {
+        ChunkWork& chunk = dispatch->chunks[index];
+        if (chunk.attempts > 0 && chunk.running_on.empty()) {
+            stats_->retries++;
+        }
+        if (chunk.attempts == 0) {
+            chunk.started = Clock::now();
+        }
+        chunk.attempts++;
+        chunk.running_on.insert(worker);
+        dispatch->busy[worker]++;
+
+        std::thread([dispatch, stats = stats_, index, worker, url = workers_[worker], items = base_items,
+                     timeout = options_.request_timeout]() mutable {
+            const ChunkWork& input = dispatch->chunks[index];
+            items.push_back({"audio", input.wav, "chunk.wav", "audio/wav"});
+
+            httplib::Client client(url);
+            client.set_connection_timeout(5);
+            client.set_read_timeout(static_cast<time_t>(timeout));
+            client.set_write_timeout(static_cast<time_t>(timeout));
+
+            // stop() only reaches a request whose connection is open; one abandoned while
+            // it was still connecting is shut down here instead
+            client.set_socket_options([dispatch](socket_t sock) {
+                if (dispatch->abandoned) {
+                    ::shutdown(sock, SHUT_RDWR);
+                }
+            });
+
+            bool started = false;
+            {
+                std::lock_guard<std::mutex> lock(dispatch->mutex);
+                if (!dispatch->abandoned && !dispatch->chunks[index].done) {
+                    dispatch->clients[{index, worker}] = &client;
+                    started = true;
+                }
+            }
+
+            json result;
+            std::string error;
+            bool rejected = false;
+            if (started) {
+                auto response = client.Post("/api/transcribe", items);
+                if (!response) {
+                    error = url + ": " + httplib::to_string(response.error());
+                } else if (response->status != 200) {
+                    error = url + ": HTTP " + std::to_string(response->status) + ": " + response->body.substr(0, 500);
+                    rejected = response->status >= 400 && response->status < 500 && response->status != 429;
+                } else {
+                    result = json::parse(response->body, nullptr, false);
+                    if (result.is_discarded() || !result.contains("segments")) {
+                        error = url + ": malformed response";
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(dispatch->mutex);
+            dispatch->clients.erase({index, worker});
+            ChunkWork& chunk = dispatch->chunks[index];
+            dispatch->busy[worker]--;
+            chunk.running_on.erase(worker);
+            if (dispatch->abandoned || chunk.done) {
+                // Stopped, or the other copy of a hedged chunk answered first
+            } else if (!error.empty()) {
+                stats->failures++;
+                chunk.failed_on.insert(worker);
+                chunk.last_error = error;
+                if (rejected && dispatch->rejected.empty()) {
+                    dispatch->rejected = error;
+                }
+            } else {
+                chunk.done = true;
+                chunk.result = std::move(result);
+                chunk.winner = worker;
+                chunk.latency = std::chrono::duration<double>(Clock::now() - chunk.started).count();
+                if (worker == chunk.hedge_worker) {
+                    stats->hedge_wins++;
+                }
+                stop_requests_locked(*dispatch, index, worker);
+            }
+            dispatch->cv.notify_all();
+        }).detach();
+    };
+
+    std::unique_lock<std::mutex> lock(dispatch->mutex);
+    AbandonOnExit abandon(*dispatch);
+    while (true) {
+        if (cancel != nullptr && cancel->cancelled()) {
+            throw CancelledError(cancel->reason());
+        }
+        if (!dispatch->rejected.empty()) {
+            throw std::invalid_argument("Worker rejected the request: " + dispatch->rejected);
+        }
+
+        // Expected processing time per audio second, from the chunks finished so far
+        std::vector<double> rates;
+        bool all_done = true;
+        for (const ChunkWork& chunk : dispatch->chunks) {
+            if (chunk.done) {
+                rates.push_back(chunk.latency / std::max(chunk.audio_seconds, 1.0));
+            } else {
+                all_done = false;
+            }
+        }
+        if (all_done) {
+            break;
+        }
+        const double rate = median(rates);
+
+        const auto now = Clock::now();
+        for (size_t i = 0; i < dispatch->chunks.size(); ++i) {
+            ChunkWork& chunk = dispatch->chunks[i];
+            if (chunk.done) {
+                continue;
+            }
+
+            if (chunk.running_on.empty()) {
+                if (chunk.attempts >= options_.max_attempts) {
+                    throw std::runtime_error("Chunk at " + std::to_string(chunk.offset_seconds) + "s failed after " +
+                                             std::to_string(chunk.attempts) + " attempts: " + chunk.last_error);
+                }
+                const size_t worker = pick_worker(*dispatch, chunk);
+                if (worker < workers_.size()) {
+                    launch(i, worker);
+                }
+            } else if (!chunk.hedged && options_.hedge_factor > 0.0 && rate > 0.0) {
+                // Straggler: duplicate it on an idle worker and keep whichever answers first
+                const double elapsed = std::chrono::duration<double>(now - chunk.started).count();
+                if (elapsed > options_.hedge_factor * rate * std::max(chunk.audio_seconds, 1.0)) {
+                    const size_t worker = pick_worker(*dispatch, chunk);
+                    if (worker < workers_.size()) {
+                        chunk.hedged = true;
+                        chunk.hedge_worker = worker;
+                        stats_->hedges++;
+                        launch(i, worker);
+                    }
+                }
+            }
+        }
+
+        dispatch->cv.wait_for(lock, std::chrono::milliseconds(100));
+    }
+
+    // Stitch: shift every chunk's times by its offset in the recording
+    json segments = json::array();
+    json words;
+    json tokens;
+    json shards = json::array();
+    for (const ChunkWork& chunk : dispatch->chunks) {
+        const size_t segment_base = segments.size();
+        for (json segment : chunk.result["segments"]) {
+            segment["timeStart"] = segment["timeStart"].get<double>() + chunk.offset_seconds;
+            segment["timeEnd"] = segment["timeEnd"].get<double>() + chunk.offset_seconds;
+            segments.push_back(segment);
+        }
+        if (chunk.result.contains("words")) {
+            append_columns(words, chunk.result["words"], chunk.offset_seconds, segment_base);
+        }
+        if (chunk.result.contains("tokens")) {
+            append_columns(tokens, chunk.result["tokens"], chunk.offset_seconds, segment_base);
+        }
+        shards.push_back({
+            {"worker", workers_[chunk.winner]},
+            {"offset", chunk.offset_seconds},
+            {"duration", chunk.audio_seconds},
+            {"attempts", chunk.attempts},
+            {"hedged", chunk.hedged},
+            {"latency", chunk.latency}
+        });
+    }
+
+    json result = {{"segments", segments}, {"shards", shards}};
+    if (!words.is_null()) {
+        result["words"] = words;
+    }
+    if (!tokens.is_null()) {
+        result["tokens"] = tokens;
+    }
+    return result;
+}
+
+json ShardCoordinator::metrics() const {
+    return {
+        {"workers", workers_},
+        {"requests", stats_->requests.load()},
+        {"chunks", stats_->chunks.load()},
+        {"retries", stats_->retries.load()},
+        {"hedges", stats_->hedges.load()},
+        {"hedgeWins", stats_->hedge_wins.load()},
+        {"failures", stats_->failures.load()}
+    };
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cancellation.h"
+#include "nlohmann/json.hpp"
+
+// Sample range [begin, end) of a longer recording
+struct AudioChunk {
+    size_t begin;
+    size_t end;
+};
+
+// Split 16 kHz samples into chunks of about target_seconds. Each cut is placed at the
+// quietest 20 ms frame within search_seconds of the target, so words aren't cut in half.
+std::vector<AudioChunk> split_at_silence(const std::vector<float>& samples, double target_seconds, double search_seconds);
+
+// 16 kHz mono 16-bit PCM WAV file
+std::string encode_wav(const float* samples, size_t count);
+
+// "http://host:port,http://host:port" -> one entry per worker
+std::vector<std::string> parse_worker_list(const std::string& value);
+
+// Fans a long recording out to worker whisper_service instances and stitches the results.
+//
+// Chunks are dispatched to idle workers (one chunk per worker at a time). A failed chunk
+// is retried on another worker; a chunk that runs well past the time the finished chunks
+// suggest is hedged by sending a duplicate to an idle worker, and the first answer wins; the
+// other copy is stopped. Requests still in flight when transcribe() returns or throws (e.g.
+// on cancellation) are stopped too, so workers don't keep transcribing abandoned chunks.
+class ShardCoordinator {
+public:
+    struct Options {
+        double chunk_seconds = 300.0;
+        double search_seconds = 15.0;
+        int max_attempts = 3;
+        double hedge_factor = 2.0;   // hedge past this multiple of the expected chunk time; 0 disables
+        double request_timeout = 600.0;
+    };
+
+    ShardCoordinator(std::vector<std::string> workers, Options options);
+
+    // Transcribe samples across the workers. fields are forwarded as form fields with
+    // every chunk. Throws CancelledError if the token is cancelled, std::invalid_argument
+    // if a worker rejects the request itself, and std::runtime_error when a chunk fails
+    // on every attempt.
+    nlohmann::json transcribe(const std::vector<float>& samples,
+                              const std::vector<std::pair<std::string, std::string>>& fields,
+                              CancellationToken* cancel = nullptr);
+
+    const std::vector<std::string>& workers() const { return workers_; }
+
+    nlohmann::json metrics() const;
+
+private:
+    struct Stats;
+
+    const std::vector<std::string> workers_;
+    const Options options_;
+    // Shared with in-flight requests, which can outlive a transcribe() call once a hedge has won
+    std::shared_ptr<Stats> stats_;
+};
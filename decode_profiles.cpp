@@ -0,0 +1,155 @@
+#include "decode_profiles.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+using json = nlohmann::json;
+
+namespace {
+
+std::map<std::string, DecodeProfile> builtin_profiles() {
+    std::map<std::string, DecodeProfile> profiles;
+
+    // One greedy candidate, no temperature fallback, no conditioning on the previous window
+    DecodeProfile fast;
+    fast.name = "fast";
+    fast.best_of = 1;
+    fast.temperature_inc = 0.0f;
+    fast.no_context = true;
+    profiles[fast.name] = fast;
+
+    // whisper's defaults: greedy with temperature fallback
+    DecodeProfile balanced;
+    balanced.name = "balanced";
+    profiles[balanced.name] = balanced;
+
+    DecodeProfile accurate;
+    accurate.name = "accurate";
+    accurate.beam_search = true;
+    accurate.beam_size = 5;
+    accurate.best_of = 5;
+    profiles[accurate.name] = accurate;
+
+    return profiles;
+}
+
+DecodeProfile profile_from_json(const std::string& name, const json& config) {
+    DecodeProfile profile;
+    profile.name = name;
+
+    const std::string strategy = config.value("strategy", "greedy");
+    if (strategy != "greedy" && strategy != "beam") {
+        throw std::invalid_argument("profile " + name + ": unknown strategy " + strategy);
+    }
+    profile.beam_search = strategy == "beam";
+
+    auto read = [&config](const char* key, auto& field) {
+        if (config.contains(key)) {
+            field = config.at(key).get<typename std::remove_reference_t<decltype(field)>::value_type>();
+        }
+    };
+    read("best_of", profile.best_of);
+    read("beam_size", profile.beam_size);
+    read("temperature_inc", profile.temperature_inc);
+    read("entropy_thold", profile.entropy_thold);
+    read("logprob_thold", profile.logprob_thold);
+    read("audio_ctx", profile.audio_ctx);
+    read("no_context", profile.no_context);
+    read("single_segment", profile.single_segment);
+    read("max_len", profile.max_len);
+    read("max_tokens", profile.max_tokens);
+    return profile;
+}
+
+} // namespace
+
+whisper_full_params make_full_params(const DecodeProfile& profile) {
+    whisper_full_params params = whisper_full_default_params(
+        profile.beam_search ? WHISPER_SAMPLING_BEAM_SEARCH : WHISPER_SAMPLING_GREEDY);
+
+    if (profile.best_of) params.greedy.best_of = *profile.best_of;
+    if (profile.beam_size) params.beam_search.beam_size = *profile.beam_size;
+    if (profile.temperature_inc) params.temperature_inc = *profile.temperature_inc;
+    if (profile.entropy_thold) params.entropy_thold = *profile.entropy_thold;
+    if (profile.logprob_thold) params.logprob_thold = *profile.logprob_thold;
+    if (profile.audio_ctx) params.audio_ctx = *profile.audio_ctx;
+    if (profile.no_context) params.no_context = *profile.no_context;
+    if (profile.single_segment) params.single_segment = *profile.single_segment;
+    if (profile.max_len) params.max_len = *profile.max_len;
+    if (profile.max_tokens) params.max_tokens = *profile.max_tokens;
+    return params;
+}
+
+DecodeProfiles::DecodeProfiles(std::string path, std::string default_name)
+    : path_(std::move(path)), default_name_(std::move(default_name)), profiles_(builtin_profiles()) {
+    reload();
+}
+
+void DecodeProfiles::reload() {
+    std::map<std::string, DecodeProfile> profiles = builtin_profiles();
+
+    std::ifstream file(path_);
+    if (file.is_open()) {
+        try {
+            json config = json::parse(file);
+            for (auto it = config.begin(); it != config.end(); ++it) {
+                profiles[it.key()] = profile_from_json(it.key(), it.value());
+            }
+            std::cerr << "Loaded " << config.size() << " decode profiles from " << path_ << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: ignoring decode profiles in " << path_ << ": " << e.what() << std::endl;
+            return;
+        }
+    }
+
+    if (profiles.find(default_name_) == profiles.end()) {
+        std::cerr << "Warning: default decode profile " << default_name_ << " is not defined" << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    profiles_ = std::move(profiles);
+}
+
+DecodeProfile DecodeProfiles::get(const std::string& name) const {
+    const std::string& key = name.empty() ? default_name_ : name;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = profiles_.find(key);
+    if (it == profiles_.end()) {
+        throw std::invalid_argument("Unknown decode profile: " + key);
+    }
+    return it->second;
+}
+
+void DecodeProfiles::record(const std::string& name, double audio_seconds, double inference_seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Measurements& m = measurements_[name];
+    m.count++;
+    m.audio_seconds += audio_seconds;
+    m.inference_seconds += inference_seconds;
+}
+
+double DecodeProfiles::real_time_factor(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = measurements_.find(name);
+    if (it == measurements_.end() || it->second.audio_seconds <= 0.0) {
+        return 0.0;
+    }
+    return it->second.inference_seconds / it->second.audio_seconds;
+}
+
+json DecodeProfiles::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    json metrics = json::object();
+    for (const auto& [name, profile] : profiles_) {
+        auto it = measurements_.find(name);
+        const Measurements m = it != measurements_.end() ? it->second : Measurements();
+        metrics[name] = {
+            {"strategy", profile.beam_search ? "beam" : "greedy"},
+            {"requests", m.count},
+            {"realTimeFactor", m.audio_seconds > 0.0 ? m.inference_seconds / m.audio_seconds : 0.0}
+        };
+    }
+    return metrics;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include "nlohmann/json.hpp"
+#include "whisper.h"
+
+// Named decoder settings that trade accuracy for speed. Unset fields keep whisper's defaults.
+struct DecodeProfile {
+    std::string name = "balanced";
+    bool beam_search = false;
+    std::optional<int> best_of;
+    std::optional<int> beam_size;
+    std::optional<float> temperature_inc;  // 0 disables the temperature fallback
+    std::optional<float> entropy_thold;
+    std::optional<float> logprob_thold;
+    std::optional<int> audio_ctx;          // encoder context; < 1500 is faster, best for short clips
+    std::optional<bool> no_context;
+    std::optional<bool> single_segment;
+    std::optional<int> max_len;
+    std::optional<int> max_tokens;
+};
+
+// whisper_full_params for a profile, on top of whisper's defaults for its sampling strategy
+whisper_full_params make_full_params(const DecodeProfile& profile);
+
+// The built-in profiles (fast, balanced, accurate) plus any defined in a JSON config file:
+//   {"name": {"strategy": "greedy" | "beam", "best_of": 1, "beam_size": 5, "temperature_inc": 0.0,
+//             "entropy_thold": 2.4, "logprob_thold": -1.0, "audio_ctx": 768, "no_context": true,
+//             "single_segment": false, "max_len": 0, "max_tokens": 0}}
+// A profile in the file replaces a built-in one of the same name. Measured real-time
+// factors are kept per profile. Thread-safe.
+class DecodeProfiles {
+public:
+    DecodeProfiles(std::string path, std::string default_name);
+
+    // Re-read the config file (keeps the previous profiles if it is invalid)
+    void reload();
+
+    // Throws std::invalid_argument for unknown names; empty selects the default profile
+    DecodeProfile get(const std::string& name) const;
+
+    void record(const std::string& name, double audio_seconds, double inference_seconds);
+
+    // Inference seconds per audio second measured for a profile so far; 0 until measured
+    double real_time_factor(const std::string& name) const;
+
+    nlohmann::json metrics() const;
+
+private:
+    struct Measurements {
+        uint64_t count = 0;
+        double audio_seconds = 0.0;
+        double inference_seconds = 0.0;
+    };
+
+    const std::string path_;
+    const std::string default_name_;
+    mutable std::mutex mutex_;
+    std::map<std::string, DecodeProfile> profiles_;
+    std::map<std::string, Measurements> measurements_;
+};
@@ -0,0 +1,208 @@
+#include "engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include "audio.h"
+
+using json = nlohmann::json;
+
+WhisperEngine::WhisperEngine(Config config)
+    : config_(std::move(config)),
+      scheduler_(config_.inference_slots, config_.class_weights, config_.initial_rtf),
+      context_profiles_(config_.context_profiles_path),
+      decode_profiles_(config_.decode_profiles_path, config_.default_profile) {}
+
+std::shared_ptr<WhisperModel> WhisperEngine::open_model(const std::string& path) const {
+    const std::string& model_path = path.empty() ? config_.model_path : path;
+    std::shared_ptr<WhisperModel> model = WhisperModel::load(model_path, make_context_params());
+    if (!model) {
+        throw std::runtime_error("Failed to load model " + model_path);
+    }
+    return model;
+}
+
+void WhisperEngine::warm_up(WhisperModel& model, int n_threads) const {
+    // Concurrent inferences share the cores
+    const int max_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) /
+                                            std::max(1, config_.inference_slots));
+    const int threads = n_threads > 0 ? n_threads : config_.n_threads;
+    if (threads > 0) {
+        model.set_n_threads(threads);
+    }
+    if (!config_.warm_up) {
+        return;
+    }
+    try {
+        warm_up_model(model, max_threads, threads <= 0);
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Warm-up failed: ") + e.what());
+    }
+}
+
+std::shared_ptr<WhisperModel> WhisperEngine::load_model(const std::string& path, int n_threads) const {
+    std::shared_ptr<WhisperModel> model = open_model(path);
+    warm_up(*model, n_threads);
+    return model;
+}
+
+std::shared_ptr<WhisperModel> WhisperEngine::load_draft_model(int n_threads) const {
+    if (config_.draft_model_path.empty()) {
+        return nullptr;
+    }
+
+    // DTW alignment heads are model specific; the draft model uses heuristic token timings
+    whisper_context_params params = make_context_params();
+    params.dtw_token_timestamps = false;
+    std::shared_ptr<WhisperModel> model = WhisperModel::load(config_.draft_model_path, params);
+    if (!model) {
+        throw std::runtime_error("Failed to load draft model " + config_.draft_model_path);
+    }
+    warm_up(*model, n_threads);
+    return model;
+}
+
+void WhisperEngine::set_model(std::shared_ptr<WhisperModel> model) {
+    std::atomic_store(&model_, std::move(model));
+    context_profiles_.clear_cache();
+    {
+        // Waiters check the model under this lock, so the notification can't slip in between
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+    }
+    model_published_.notify_all();
+}
+
+std::shared_ptr<WhisperModel> WhisperEngine::wait_for_model() {
+    std::unique_lock<std::mutex> lock(wait_mutex_);
+    model_published_.wait(lock, [this]() { return stop_waiting_ || model() != nullptr; });
+    return stop_waiting_ ? nullptr : model();
+}
+
+void WhisperEngine::stop_waiting() {
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        stop_waiting_ = true;
+    }
+    model_published_.notify_all();
+}
+
+TranscribeOptions WhisperEngine::options(const std::shared_ptr<WhisperModel>& model, const std::string& profile,
+                                         const std::string& tenant) {
+    TranscribeOptions options;
+    options.profile = decode_profiles_.get(profile);
+    if (model) {
+        options.context = context_profiles_.get(*model, tenant);
+    }
+    return options;
+}
+
+TranscribeOptions WhisperEngine::options(const std::string& profile, const std::string& tenant) {
+    return options(model(), profile, tenant);
+}
+
+json WhisperEngine::run_in_slot(const Request& request, double audio_seconds, const char* timing, bool update_rtf,
+                                const std::function<json(WhisperModel&)>& infer, const std::function<void()>& draft) {
+    const std::shared_ptr<WhisperModel> current = request.model ? request.model : model();
+    if (!current) {
+        throw std::runtime_error("Model not loaded");
+    }
+
+    const auto start_time = InferenceScheduler::Clock::now();
+    const auto received = request.received == InferenceScheduler::Clock::time_point{} ? start_time : request.received;
+    try {
+        json result;
+        double queue_time = 0.0;
+        double draft_time = 0.0;
+        double infer_time = 0.0;
+        {
+            InferenceScheduler::Slot slot = scheduler_.acquire(request.priority, request.deadline, audio_seconds, request.cancel,
+                                                                  request.admission_checked);
+            const auto slot_start = InferenceScheduler::Clock::now();
+            queue_time = std::chrono::duration<double>(slot_start - start_time).count();
+            if (draft) {
+                draft();
+            }
+            const auto infer_start = InferenceScheduler::Clock::now();
+            draft_time = std::chrono::duration<double>(infer_start - slot_start).count();
+            result = infer(*current);
+            infer_time = std::chrono::duration<double>(InferenceScheduler::Clock::now() - infer_start).count();
+        }
+
+        // The draft pass runs another model, so only the main pass feeds the real-time factor
+        const double latency = std::chrono::duration<double>(InferenceScheduler::Clock::now() - received).count();
+        scheduler_.record_completion(request.priority, latency, audio_seconds, infer_time, update_rtf);
+        result["executionTime"] = {{"queue", queue_time}, {timing, infer_time}};
+        if (draft) {
+            result["executionTime"]["draft"] = draft_time;
+        }
+        return result;
+    } catch (const DeadlineError&) {
+        throw;
+    } catch (const CancelledError& e) {
+        scheduler_.record_cancellation(request.priority, e.reason);
+        throw;
+    } catch (const std::exception&) {
+        scheduler_.record_failure(request.priority);
+        throw;
+    }
+}
+
+json WhisperEngine::transcribe(const std::vector<float>& samples, const TranscribeOptions& options, const Request& request) {
+    const double audio_seconds = samples.size() / static_cast<double>(WHISPER_SAMPLE_RATE);
+    std::function<void()> draft;
+    if (request.draft_model) {
+        draft = [&]() {
+            transcribe_audio(*request.draft_model, samples, request.draft_options, request.cancel);
+            if (request.on_draft_done) {
+                request.on_draft_done();
+            }
+        };
+    }
+    json result = run_in_slot(request, audio_seconds, "transcribe", true, [&](WhisperModel& current) {
+        return transcribe_audio(current, samples, options, request.cancel);
+    }, draft);
+
+    const double transcribe_time = result["executionTime"]["transcribe"];
+    decode_profiles_.record(options.profile.name, audio_seconds, transcribe_time);
+    result["profile"] = {
+        {"name", options.profile.name},
+        {"realTimeFactor", audio_seconds > 0.0 ? transcribe_time / audio_seconds : 0.0},
+        {"measuredRealTimeFactor", decode_profiles_.real_time_factor(options.profile.name)}
+    };
+    return result;
+}
+
+json WhisperEngine::transcribe(const std::vector<float>& samples, const TranscribeOptions& options, PriorityClass priority,
+                               InferenceScheduler::Clock::time_point deadline, CancellationToken* cancel) {
+    Request request;
+    request.priority = priority;
+    request.deadline = deadline;
+    request.cancel = cancel;
+    return transcribe(samples, options, request);
+}
+
+json WhisperEngine::detect_language(const std::vector<float>& samples, int top_k, const Request& request) {
+    const double audio_seconds = samples.size() / static_cast<double>(WHISPER_SAMPLE_RATE);
+
+    // One encoder pass says nothing about the cost of transcribing the clip
+    return run_in_slot(request, audio_seconds, "detect", false, [&](WhisperModel& current) {
+        return ::detect_language(current, samples, top_k);
+    });
+}
+
+json WhisperEngine::transcribe_file(const std::string& path, const TranscribeOptions& options, const Request& request) {
+    return transcribe(load_local_audio(path, 0.0, 0.0, request.cancel), options, request);
+}
+
+json WhisperEngine::transcribe_file(const std::string& path, const TranscribeOptions& options, PriorityClass priority,
+                                    InferenceScheduler::Clock::time_point deadline, CancellationToken* cancel) {
+    // Pinned before the audio is read, so a reload meanwhile doesn't change the model under the options
+    Request request;
+    request.priority = priority;
+    request.deadline = deadline;
+    request.cancel = cancel;
+    request.model = model();
+    return transcribe_file(path, options, request);
+}
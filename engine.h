@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "cancellation.h"
+#include "context_profiles.h"
+#include "decode_profiles.h"
+#include "scheduler.h"
+#include "transcription.h"
+#include "whisper_model.h"
+
+// Model served by default
+const std::string MODEL_PATH = "models/ggml-base.en.bin";
+
+// A long-lived transcription engine: the current model generation (whose weights and
+// whisper_state pool are shared by every inference), the decode and tenant profiles, and
+// the inference scheduler. whisper_service and whisper_cli are built on it, and other
+// services can link whisper_engine and call it in-process instead of going through HTTP.
+// Thread-safe.
+class WhisperEngine {
+public:
+    struct Config {
+        std::string model_path = MODEL_PATH;
+        int inference_slots = 1;
+        std::array<double, PRIORITY_CLASS_COUNT> class_weights = {8.0, 4.0, 1.0};
+        double initial_rtf = 0.5;
+
+        // Threads per inference; 0 picks the fastest on this host when the model is warmed up
+        int n_threads = 0;
+        bool warm_up = true;
+
+        std::string context_profiles_path = "models/context_profiles.json";
+        std::string decode_profiles_path = "models/decode_profiles.json";
+        std::string default_profile = "balanced";
+
+        // Optional small model for draft-then-refine requests; empty for none
+        std::string draft_model_path;
+    };
+
+    // One transcription; the defaults suit one-off calls
+    struct Request {
+        PriorityClass priority = PriorityClass::Standard;
+        InferenceScheduler::Clock::time_point deadline = InferenceScheduler::Clock::time_point::max();
+        CancellationToken* cancel = nullptr;
+
+        // Set when the caller already ran scheduler().check_admission, which counted the request
+        bool admission_checked = false;
+
+        // Generation to run on, i.e. the one the options' tenant context was tokenized for;
+        // the current one when null
+        std::shared_ptr<WhisperModel> model;
+
+        // When the request arrived, so the recorded latency covers its conversion as well;
+        // the start of the call when unset
+        InferenceScheduler::Clock::time_point received{};
+
+        // Draft-then-refine: draft_model first transcribes with draft_options (whose on_segment
+        // streams the draft), then on_draft_done runs, then the main pass; both in one slot.
+        // The draft pass is reported as executionTime "draft" and not counted in the
+        // real-time factor estimates.
+        std::shared_ptr<WhisperModel> draft_model;
+        TranscribeOptions draft_options;
+        std::function<void()> on_draft_done;
+    };
+
+    // No model is loaded yet; see load_model and set_model
+    explicit WhisperEngine(Config config);
+
+    // Load the weights of a model generation from path (the configured one when empty),
+    // without warming it up or publishing it. Throws std::runtime_error when it can't be loaded.
+    std::shared_ptr<WhisperModel> open_model(const std::string& path = "") const;
+
+    // Set the threads per inference and warm the model up. n_threads > 0 keeps that count
+    // (a reload keeps the current generation's); 0 takes the configured one or, when that is
+    // 0 too, the fastest on this host. Throws std::runtime_error when the warm-up fails.
+    void warm_up(WhisperModel& model, int n_threads = 0) const;
+
+    // open_model and warm_up
+    std::shared_ptr<WhisperModel> load_model(const std::string& path = "", int n_threads = 0) const;
+
+    // The configured draft model, warmed up with n_threads, or nullptr when none is configured.
+    // Throws std::runtime_error when it can't be loaded.
+    std::shared_ptr<WhisperModel> load_draft_model(int n_threads) const;
+
+    // The current generation, or nullptr. Callers hold on to the one they started with;
+    // a replaced generation is freed when its last user is done.
+    std::shared_ptr<WhisperModel> model() const { return std::atomic_load(&model_); }
+
+    // Publish a generation; tenant contexts tokenized for the previous one are dropped
+    void set_model(std::shared_ptr<WhisperModel> model);
+
+    // Block until a generation is published (e.g. by a reload after a failed startup load);
+    // nullptr once stop_waiting was called
+    std::shared_ptr<WhisperModel> wait_for_model();
+
+    // Wake wait_for_model callers on shutdown
+    void stop_waiting();
+
+    std::shared_ptr<WhisperModel> draft_model() const { return std::atomic_load(&draft_model_); }
+    void set_draft_model(std::shared_ptr<WhisperModel> model) { std::atomic_store(&draft_model_, std::move(model)); }
+
+    // Options with a decode profile (empty selects the default) and the tenant's context
+    // tokenized for model, which the request must then run on (Request::model). Throws
+    // std::invalid_argument for unknown profiles.
+    TranscribeOptions options(const std::shared_ptr<WhisperModel>& model, const std::string& profile = "",
+                              const std::string& tenant = "");
+
+    // Same for the current model, for callers that don't reload it
+    TranscribeOptions options(const std::string& profile = "", const std::string& tenant = "");
+
+    // Transcribe 16 kHz mono samples once the scheduler grants a slot, and record the outcome
+    // with the scheduler and the decode profile. The result has the shape of the
+    // /api/transcribe response, with "profile" and "executionTime" {queue, transcribe}, plus
+    // draft for draft-then-refine requests.
+    nlohmann::json transcribe(const std::vector<float>& samples, const TranscribeOptions& options, const Request& request);
+
+    nlohmann::json transcribe(const std::vector<float>& samples, const TranscribeOptions& options,
+                              PriorityClass priority = PriorityClass::Standard,
+                              InferenceScheduler::Clock::time_point deadline = InferenceScheduler::Clock::time_point::max(),
+                              CancellationToken* cancel = nullptr);
+
+    // Same for any file ffmpeg can read; 16 kHz mono WAVs are read without ffmpeg
+    nlohmann::json transcribe_file(const std::string& path, const TranscribeOptions& options, const Request& request);
+
+    nlohmann::json transcribe_file(const std::string& path, const TranscribeOptions& options,
+                                   PriorityClass priority = PriorityClass::Standard,
+                                   InferenceScheduler::Clock::time_point deadline = InferenceScheduler::Clock::time_point::max(),
+                                   CancellationToken* cancel = nullptr);
+
+    // Language identification in a scheduler slot (see ::detect_language); it doesn't count
+    // towards the real-time factor estimate. "executionTime" is {queue, detect}.
+    nlohmann::json detect_language(const std::vector<float>& samples, int top_k, const Request& request);
+
+    InferenceScheduler& scheduler() { return scheduler_; }
+    ContextProfiles& context_profiles() { return context_profiles_; }
+    DecodeProfiles& decode_profiles() { return decode_profiles_; }
+    const Config& config() const { return config_; }
+
+private:
+    // Runs draft (if any) and then infer on the request's generation in a scheduler slot,
+    // records the outcome and adds "executionTime" {queue, <timing>, draft}. Only infer is
+    // timed as inference.
+    nlohmann::json run_in_slot(const Request& request, double audio_seconds, const char* timing, bool update_rtf,
+                               const std::function<nlohmann::json(WhisperModel&)>& infer,
+                               const std::function<void()>& draft = nullptr);
+
+    const Config config_;
+    InferenceScheduler scheduler_;
+    ContextProfiles context_profiles_;
+    DecodeProfiles decode_profiles_;
+    std::shared_ptr<WhisperModel> model_;
+    std::shared_ptr<WhisperModel> draft_model_;
+
+    std::mutex wait_mutex_;
+    std::condition_variable model_published_;
+    bool stop_waiting_ = false;
+};
@@ -0,0 +1,127 @@
+// Picks the fastest build of a program that this CPU can run and execs it.
+//
+// The image carries one build per x86 ISA level under <root>/<isa>/<program>; this launcher
+// itself is built for the baseline ISA, reads the CPU features with CPUID (and XGETBV, for
+// the register state the OS saves), and replaces itself with the best match:
+//
+//   whisper_launch whisper_service [args...]
+//   whisper_launch --check avx2      (exit status 0 when this CPU can run the avx2 build)
+//
+// WHISPER_ISA forces a level, WHISPER_ISA_ROOT overrides <root> (default: isa/ next to the
+// launcher). The chosen level is passed on in WHISPER_ISA_SELECTED.
+
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace {
+
+// Best first; "native" is a build for the build host, taken as is when present
+const std::vector<std::string> ISA_LEVELS = {"avx512", "avx2", "sse42", "native"};
+
+bool cpu_supports(const std::string& isa) {
+    if (isa == "native") {
+        return true;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    const bool sse42 = ecx & (1u << 20);
+    const bool fma = ecx & (1u << 12);
+    const bool f16c = ecx & (1u << 29);
+    const bool osxsave = ecx & (1u << 27);
+    const bool avx = ecx & (1u << 28);
+    if (isa == "sse42") {
+        return sse42;
+    }
+
+    // AVX registers are only usable when the OS saves their state on context switches
+    uint64_t xcr0 = 0;
+    if (osxsave) {
+        unsigned int lo = 0, hi = 0;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        xcr0 = (static_cast<uint64_t>(hi) << 32) | lo;
+    }
+    const bool avx_state = (xcr0 & 0x6) == 0x6;          // SSE and AVX state
+    const bool avx512_state = (xcr0 & 0xE6) == 0xE6;     // plus opmask and ZMM state
+
+    unsigned int ebx7 = 0;
+    if (__get_cpuid_count(7, 0, &eax, &ebx7, &ecx, &edx) == 0) {
+        ebx7 = 0;
+    }
+    const bool avx2 = ebx7 & (1u << 5);
+    const bool avx512f = ebx7 & (1u << 16);
+    const bool avx512bw = ebx7 & (1u << 30);
+
+    const bool avx2_level = sse42 && avx && avx2 && fma && f16c && avx_state;
+    if (isa == "avx2") {
+        return avx2_level;
+    }
+    if (isa == "avx512") {
+        return avx2_level && avx512f && avx512bw && avx512_state;
+    }
+#endif
+    return false;
+}
+
+std::string launcher_dir() {
+    char path[PATH_MAX];
+    const ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n <= 0) {
+        return ".";
+    }
+    const std::string exe(path, static_cast<size_t>(n));
+    return exe.substr(0, exe.find_last_of('/'));
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc == 3 && std::string(argv[1]) == "--check") {
+        return cpu_supports(argv[2]) ? 0 : 1;
+    }
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <program> [args...]" << std::endl;
+        std::cerr << "       " << argv[0] << " --check <avx512|avx2|sse42>" << std::endl;
+        return 1;
+    }
+
+    const char* root_env = std::getenv("WHISPER_ISA_ROOT");
+    const std::string root = root_env != nullptr && *root_env != '\0' ? root_env : launcher_dir() + "/isa";
+    const std::string program = argv[1];
+
+    std::vector<std::string> candidates = ISA_LEVELS;
+    if (const char* forced = std::getenv("WHISPER_ISA"); forced != nullptr && *forced != '\0') {
+        candidates = {forced};
+    }
+
+    for (const std::string& isa : candidates) {
+        const std::string path = root + "/" + isa + "/" + program;
+        if (access(path.c_str(), X_OK) != 0 || (candidates.size() > 1 && !cpu_supports(isa))) {
+            continue;
+        }
+
+        std::cerr << "Running the " << isa << " build of " << program << std::endl;
+        setenv("WHISPER_ISA_SELECTED", isa.c_str(), 1);
+        std::vector<char*> args = {const_cast<char*>(path.c_str())};
+        for (int i = 2; i < argc; ++i) {
+            args.push_back(argv[i]);
+        }
+        args.push_back(nullptr);
+        execv(path.c_str(), args.data());
+        std::cerr << "Failed to run " << path << std::endl;
+        return 127;
+    }
+
+    std::cerr << "No build of " << program << " under " << root << " runs on this CPU" << std::endl;
+    return 127;
+}
@@ -0,0 +1,399 @@
+#include "job_queue.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+int64_t unix_now() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string new_job_id() {
+    static std::mutex mutex;
+    static std::mt19937_64 rng(std::random_device{}());
+    std::lock_guard<std::mutex> lock(mutex);
+    char id[17];
+    std::snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(rng()));
+    return id;
+}
+
+void write_all(int fd, const char* data, size_t size, const std::string& path) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to write " + path + ": " + std::strerror(errno));
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// A new directory entry is only durable once the directory itself is synced
+void sync_directory(const std::string& dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Write a file and fsync it before returning
+void write_durable(const std::string& path, const std::string& content) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create " + path + ": " + std::strerror(errno));
+    }
+    try {
+        write_all(fd, content.data(), content.size(), path);
+        if (fsync(fd) != 0) {
+            throw std::runtime_error("Failed to sync " + path + ": " + std::strerror(errno));
+        }
+    } catch (...) {
+        close(fd);
+        unlink(path.c_str());
+        throw;
+    }
+    close(fd);
+}
+
+// Readers see either the old file or the complete new one, never a torn write
+void replace_durable(const std::string& path, const std::string& content) {
+    const std::string tmp = path + ".tmp";
+    write_durable(tmp, content);
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        throw std::runtime_error("Failed to rename " + tmp + ": " + std::strerror(errno));
+    }
+    sync_directory(fs::path(path).parent_path().string());
+}
+
+json job_to_json(const JobQueue::Job& job) {
+    json record = {
+        {"id", job.id},
+        {"status", job.status},
+        {"options", job.options},
+        {"attempts", job.attempts},
+        {"submitted", job.submitted}
+    };
+    if (job.finished != 0) {
+        record["finished"] = job.finished;
+    }
+    if (!job.error.empty()) {
+        record["error"] = job.error;
+    }
+    return record;
+}
+
+JobQueue::Job job_from_json(const json& record) {
+    JobQueue::Job job;
+    job.id = record.at("id").get<std::string>();
+    job.status = record.at("status").get<std::string>();
+    job.options = record.value("options", json::object());
+    job.attempts = record.value("attempts", 0);
+    job.submitted = record.value("submitted", int64_t(0));
+    job.finished = record.value("finished", int64_t(0));
+    job.error = record.value("error", "");
+    return job;
+}
+
+} // namespace
+
+JobQueue::JobQueue(const std::string& spool_dir, double retention_hours)
+    : spool_dir_(spool_dir), retention_hours_(retention_hours) {
+    fs::create_directories(fs::path(spool_dir_) / "results");
+
+    replay();
+    compact();
+
+    const std::string journal_path = spool_dir_ + "/journal.ndjson";
+    journal_fd_ = open(journal_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (journal_fd_ < 0) {
+        throw std::runtime_error("Failed to open " + journal_path + ": " + std::strerror(errno));
+    }
+    journal_writer_ = std::thread(&JobQueue::flush_loop, this);
+}
+
+JobQueue::~JobQueue() {
+    stop();
+
+    {
+        std::lock_guard<std::mutex> lock(journal_mutex_);
+        journal_stopping_ = true;
+    }
+    journal_cv_.notify_all();
+    if (journal_writer_.joinable()) {
+        journal_writer_.join();
+    }
+    if (journal_fd_ >= 0) {
+        close(journal_fd_);
+    }
+}
+
+void JobQueue::replay() {
+    std::ifstream file(spool_dir_ + "/journal.ndjson");
+    std::string line;
+    size_t records = 0;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        try {
+            Job job = job_from_json(json::parse(line));
+            jobs_[job.id] = job;
+            records++;
+        } catch (const std::exception& e) {
+            // Only the last line can be torn by a crash mid-append; nothing after it was acknowledged
+            std::cerr << "Warning: journal ends in an incomplete record, ignoring it: " << e.what() << std::endl;
+            break;
+        }
+    }
+
+    std::vector<const Job*> resumed;
+    for (auto& [id, job] : jobs_) {
+        if (job.status != "queued" && job.status != "running") {
+            continue;
+        }
+        if (!fs::exists(upload_path(id))) {
+            job.status = "failed";
+            job.error = "Spooled upload is missing";
+            job.finished = unix_now();
+        } else if (job.status == "running" && job.attempts >= MAX_ATTEMPTS) {
+            job.status = "failed";
+            job.error = "Interrupted " + std::to_string(job.attempts) + " times";
+            job.finished = unix_now();
+        } else {
+            job.status = "queued";
+            resumed.push_back(&job);
+        }
+    }
+
+    // Resume in submission order
+    std::sort(resumed.begin(), resumed.end(), [](const Job* a, const Job* b) { return a->submitted < b->submitted; });
+    for (const Job* job : resumed) {
+        pending_.push_back(job->id);
+    }
+
+    if (records > 0) {
+        std::cout << "Replayed " << records << " journal records: " << jobs_.size() << " jobs, "
+                  << pending_.size() << " to resume" << std::endl;
+    }
+}
+
+void JobQueue::compact() {
+    const int64_t cutoff = unix_now() - static_cast<int64_t>(retention_hours_ * 3600);
+
+    std::string snapshot;
+    for (auto it = jobs_.begin(); it != jobs_.end();) {
+        const Job& job = it->second;
+        const bool finished = job.status == "done" || job.status == "failed";
+        if (finished) {
+            std::error_code ec;
+            fs::remove(upload_path(job.id), ec);
+            if (job.finished < cutoff) {
+                fs::remove(result_path(job.id), ec);
+                it = jobs_.erase(it);
+                continue;
+            }
+        }
+        snapshot += job_to_json(job).dump() + "\n";
+        ++it;
+    }
+
+    replace_durable(spool_dir_ + "/journal.ndjson", snapshot);
+}
+
+void JobQueue::journal(const Job& job) {
+    std::unique_lock<std::mutex> lock(journal_mutex_);
+    if (journal_failed_ || journal_stopping_) {
+        throw std::runtime_error("Job journal is not writable");
+    }
+    journal_buffer_ += job_to_json(job).dump() + "\n";
+    const uint64_t seq = ++journal_appended_;
+    journal_cv_.notify_all();
+    journal_cv_.wait(lock, [&] { return journal_durable_ >= seq || journal_failed_; });
+    if (journal_failed_) {
+        throw std::runtime_error("Job journal is not writable");
+    }
+}
+
+void JobQueue::flush_loop() {
+    std::unique_lock<std::mutex> lock(journal_mutex_);
+    while (true) {
+        journal_cv_.wait(lock, [&] { return !journal_buffer_.empty() || journal_stopping_; });
+        if (journal_buffer_.empty()) {
+            break;
+        }
+
+        // Everything appended while the previous fsync ran goes out in this one
+        std::string batch;
+        batch.swap(journal_buffer_);
+        const uint64_t covered = journal_appended_;
+        lock.unlock();
+
+        bool ok = true;
+        try {
+            write_all(journal_fd_, batch.data(), batch.size(), "job journal");
+            ok = fdatasync(journal_fd_) == 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            ok = false;
+        }
+
+        lock.lock();
+        if (ok) {
+            journal_durable_ = covered;
+            journal_syncs_++;
+        } else {
+            journal_failed_ = true;
+        }
+        journal_cv_.notify_all();
+    }
+}
+
+std::string JobQueue::submit(const std::string& audio, const json& options) {
+    Job job;
+    job.id = new_job_id();
+    job.status = "queued";
+    job.options = options;
+    job.submitted = unix_now();
+
+    // The upload must be durable before the journal line that refers to it
+    write_durable(upload_path(job.id), audio);
+    sync_directory(spool_dir_);
+    try {
+        journal(job);
+    } catch (...) {
+        unlink(upload_path(job.id).c_str());
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_[job.id] = job;
+    pending_.push_back(job.id);
+    queue_cv_.notify_one();
+    return job.id;
+}
+
+bool JobQueue::next(Job& job) {
+    Job running;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        queue_cv_.wait(lock, [&] { return !pending_.empty() || stopping_; });
+        if (stopping_) {
+            return false;
+        }
+        Job& queued = jobs_[pending_.front()];
+        pending_.pop_front();
+        queued.status = "running";
+        queued.attempts++;
+        running = queued;
+    }
+
+    // Journaled so a job that takes the process down isn't retried forever
+    journal(running);
+    job = running;
+    return true;
+}
+
+void JobQueue::complete(const std::string& id, const json& result) {
+    // A crash before the journal line only re-runs the job; the result is rewritten atomically
+    replace_durable(result_path(id), result.dump(-1, ' ', false, json::error_handler_t::replace));
+
+    Job done;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Job& job = jobs_[id];
+        job.status = "done";
+        job.finished = unix_now();
+        done = job;
+    }
+    journal(done);
+
+    std::error_code ec;
+    fs::remove(upload_path(id), ec);
+}
+
+void JobQueue::fail(const std::string& id, const std::string& error) {
+    Job failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Job& job = jobs_[id];
+        job.status = "failed";
+        job.error = error;
+        job.finished = unix_now();
+        failed = job;
+    }
+    journal(failed);
+
+    std::error_code ec;
+    fs::remove(upload_path(id), ec);
+}
+
+json JobQueue::status(const std::string& id) const {
+    json response;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) {
+            return nullptr;
+        }
+        response = job_to_json(it->second);
+        response.erase("options");
+        auto position = std::find(pending_.begin(), pending_.end(), id);
+        if (position != pending_.end()) {
+            response["position"] = std::distance(pending_.begin(), position);
+        }
+    }
+
+    if (response["status"] == "done") {
+        std::ifstream file(result_path(id));
+        if (file.is_open()) {
+            response["result"] = json::parse(file, nullptr, false);
+        }
+    }
+    return response;
+}
+
+std::string JobQueue::upload_path(const std::string& id) const {
+    return spool_dir_ + "/" + id + ".upload";
+}
+
+std::string JobQueue::result_path(const std::string& id) const {
+    return spool_dir_ + "/results/" + id + ".json";
+}
+
+json JobQueue::metrics() const {
+    json counts = {{"queued", 0}, {"running", 0}, {"done", 0}, {"failed", 0}};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [id, job] : jobs_) {
+            counts[job.status] = counts[job.status].get<int>() + 1;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    counts["journalRecords"] = journal_appended_;
+    counts["journalSyncs"] = journal_syncs_;
+    return counts;
+}
+
+void JobQueue::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queue_cv_.notify_all();
+}
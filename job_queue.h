@@ -0,0 +1,93 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nlohmann/json.hpp"
+
+// Durable intake for asynchronous transcription jobs.
+//
+// Everything lives in a spool directory (meant for a persistent volume):
+//   journal.ndjson   append-only log, one JSON snapshot of a job per line; the last line
+//                    for an id wins. Appends are group-committed: concurrent writers share
+//                    one write + fdatasync, and submit() only returns once its line is durable.
+//   <id>.upload      the uploaded audio, fsynced before the job is journaled
+//   results/<id>.json  finished results, written with tmp + fsync + rename
+//
+// On startup the journal is replayed: queued jobs and jobs that were running when the
+// process died go back on the queue, then the journal is compacted to one line per job
+// and finished jobs past the retention period are dropped along with their results.
+class JobQueue {
+public:
+    struct Job {
+        std::string id;
+        std::string status; // queued, running, done, failed
+        nlohmann::json options;
+        int attempts = 0;
+        int64_t submitted = 0; // unix seconds
+        int64_t finished = 0;
+        std::string error;
+    };
+
+    // Jobs that keep crashing the process are failed after this many attempts
+    static constexpr int MAX_ATTEMPTS = 3;
+
+    JobQueue(const std::string& spool_dir, double retention_hours);
+    ~JobQueue();
+
+    JobQueue(const JobQueue&) = delete;
+    JobQueue& operator=(const JobQueue&) = delete;
+
+    // Spool the audio, journal the job and return its id; throws std::runtime_error on I/O errors
+    std::string submit(const std::string& audio, const nlohmann::json& options);
+
+    // Block until a job is available and mark it running; false once stop() was called
+    bool next(Job& job);
+
+    void complete(const std::string& id, const nlohmann::json& result);
+    void fail(const std::string& id, const std::string& error);
+
+    // Status (and result, once done) of a job; null when the id is unknown
+    nlohmann::json status(const std::string& id) const;
+
+    std::string upload_path(const std::string& id) const;
+
+    nlohmann::json metrics() const;
+
+    // Stop handing out jobs and wake blocked next() callers. Running jobs can still
+    // complete; the journal writer keeps going until the queue is destroyed.
+    void stop();
+
+private:
+    void replay();
+    void compact();
+    void journal(const Job& job);
+    void flush_loop();
+    std::string result_path(const std::string& id) const;
+
+    const std::string spool_dir_;
+    const double retention_hours_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::map<std::string, Job> jobs_;
+    std::deque<std::string> pending_;
+    bool stopping_ = false;
+
+    // Group commit: appenders queue lines and wait for the writer's fsync to cover them
+    mutable std::mutex journal_mutex_;
+    std::condition_variable journal_cv_;
+    std::string journal_buffer_;
+    uint64_t journal_appended_ = 0;
+    uint64_t journal_durable_ = 0;
+    uint64_t journal_syncs_ = 0;
+    bool journal_failed_ = false;
+    bool journal_stopping_ = false;
+    int journal_fd_ = -1;
+    std::thread journal_writer_;
+};
@@ -6,7 +6,31 @@
 #include "whisper.h"
 #include "httplib.h"
 #include "nlohmann/json.hpp"
+#include "audio.h"
+#include "cancellation.h"
+#include "context_profiles.h"
+#include "coordinator.h"
+#include "decode_profiles.h"
+#include "engine.h"
+#include "job_queue.h"
+#include "mapped_file.h"
+#include "memory_budget.h"
+#include "metrics.h"
+#include "scheduler.h"
+#include "scratch_file.h"
+#include "whisper_model.h"
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <condition_variable>
+#include <csignal>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
@@ -35,230 +59,118 @@ bool download_model(const std::string& model_name) {
     return true;
 }
 
-
-// Function to read audio file
-std::vector<float> read_wav_file(const std::string& audio_path) {
-    // Open file in binary mode
-    std::ifstream file(audio_path, std::ios::binary);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open audio file: " + audio_path);
+// Resolve a client-supplied path (absolute, or relative to root) to a regular file
+// inside the canonical root. Symlinks are resolved first, so they can't escape it.
+fs::path resolve_local_path(const fs::path& root, const std::string& requested) {
+    std::error_code ec;
+    fs::path resolved = fs::canonical(fs::path(requested).is_absolute() ? fs::path(requested) : root / requested, ec);
+    if (ec) {
+        throw std::invalid_argument("File not found: " + requested);
     }
 
-    // WAV header structure
-    struct WavHeader {
-        // RIFF header
-        char riff_id[4];        // "RIFF"
-        uint32_t file_size;     // File size - 8
-        char wave_id[4];        // "WAVE"
-
-        // FMT chunk
-        char fmt_id[4];         // "fmt "
-        uint32_t fmt_size;      // Format data length
-        uint16_t format;        // Format type (1 = PCM)
-        uint16_t channels;      // Number of channels
-        uint32_t sample_rate;   // Sample rate
-        uint32_t byte_rate;     // Byte rate
-        uint16_t block_align;   // Block alignment
-        uint16_t bits_per_sample; // Bits per sample
-    };
-
-    // Read the WAV header
-    WavHeader header;
-    file.read(reinterpret_cast<char*>(&header), sizeof(WavHeader));
-
-    // Verify it's a valid WAV file
-    if (strncmp(header.riff_id, "RIFF", 4) != 0 ||
-        strncmp(header.wave_id, "WAVE", 4) != 0 ||
-        strncmp(header.fmt_id, "fmt ", 4) != 0) {
-        throw std::runtime_error("Invalid WAV file format");
+    auto mismatch = std::mismatch(root.begin(), root.end(), resolved.begin(), resolved.end());
+    if (mismatch.first != root.end()) {
+        throw std::invalid_argument("Path is outside the local root: " + requested);
     }
-
-    // Check for the data chunk
-    char chunk_id[4];
-    uint32_t chunk_size;
-
-    // Skip any extra format bytes
-    if (header.fmt_size > 16) {
-        file.seekg(header.fmt_size - 16, std::ios::cur);
+    if (!fs::is_regular_file(resolved)) {
+        throw std::invalid_argument("Not a regular file: " + requested);
     }
+    return resolved;
+}
 
-    // Find the data chunk
-    while (true) {
-        if (!file.read(chunk_id, 4)) {
-            throw std::runtime_error("Could not find data chunk in WAV file");
-        }
-
-        file.read(reinterpret_cast<char*>(&chunk_size), 4);
-
-        if (strncmp(chunk_id, "data", 4) == 0) {
-            // Found the data chunk
-            break;
-        }
-
-        // Skip this chunk
-        file.seekg(chunk_size, std::ios::cur);
+// Read a per-request option from a header (when one is named), the query string or,
+// for multipart uploads, a form field
+std::string get_request_option(const httplib::Request& req, const std::string& name, const std::string& header = "") {
+    if (!header.empty() && req.has_header(header)) {
+        return req.get_header_value(header);
     }
-
-    // Calculate number of samples
-    size_t num_samples = chunk_size / (header.bits_per_sample / 8) / header.channels;
-
-    // Validate parameters
-    if (header.bits_per_sample != 16 && header.bits_per_sample != 8 && header.bits_per_sample != 32) {
-        throw std::runtime_error("Unsupported bits per sample: " + std::to_string(header.bits_per_sample));
+    if (req.has_param(name)) {
+        return req.get_param_value(name);
     }
+    if (req.has_file(name)) {
+        return req.get_file_value(name).content;
+    }
+    return "";
+}
 
-    std::cout << "WAV file details: " << std::endl;
-    std::cout << "  Channels: " << header.channels << std::endl;
-    std::cout << "  Sample rate: " << header.sample_rate << std::endl;
-    std::cout << "  Bits per sample: " << header.bits_per_sample << std::endl;
-    std::cout << "  Number of samples: " << num_samples << std::endl;
-
-    // Read the audio data
-    std::vector<float> samples(num_samples);
+// An uploaded file as stored in the request; get_file_value would copy it. The file must exist.
+const httplib::MultipartFormData& uploaded_file(const httplib::Request& req, const std::string& name) {
+    return req.files.find(name)->second;
+}
 
-    if (header.bits_per_sample == 16) {
-        // 16-bit PCM
-        std::vector<int16_t> buffer(num_samples * header.channels);
-        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels * sizeof(int16_t));
+// Deadlines further out than this can't matter to the scheduler; treated as none
+const long long MAX_DEADLINE_MS = 24LL * 60 * 60 * 1000;
 
-        // Convert to float and handle multiple channels (convert to mono by averaging)
-        for (size_t i = 0; i < num_samples; i++) {
-            float sum = 0.0f;
-            for (uint16_t c = 0; c < header.channels; c++) {
-                sum += buffer[i * header.channels + c] / 32768.0f;  // Normalize to -1.0 to 1.0
-            }
-            samples[i] = sum / header.channels;  // Average all channels
-        }
+// Convert a relative deadline in milliseconds into an absolute one; empty means no deadline
+InferenceScheduler::Clock::time_point parse_deadline(const std::string& value) {
+    if (value.empty()) {
+        return InferenceScheduler::Clock::time_point::max();
     }
-    else if (header.bits_per_sample == 8) {
-        // 8-bit PCM (usually unsigned)
-        std::vector<uint8_t> buffer(num_samples * header.channels);
-        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels);
-
-        // Convert to float and handle multiple channels
-        for (size_t i = 0; i < num_samples; i++) {
-            float sum = 0.0f;
-            for (uint16_t c = 0; c < header.channels; c++) {
-                // 8-bit PCM is usually unsigned (0-255), convert to -1.0 to 1.0
-                sum += (buffer[i * header.channels + c] - 128) / 128.0f;
-            }
-            samples[i] = sum / header.channels;
-        }
-    }
-    else if (header.bits_per_sample == 32) {
-        // 32-bit float
-        std::vector<float> buffer(num_samples * header.channels);
-        file.read(reinterpret_cast<char*>(buffer.data()), num_samples * header.channels * sizeof(float));
-
-        // Handle multiple channels
-        for (size_t i = 0; i < num_samples; i++) {
-            float sum = 0.0f;
-            for (uint16_t c = 0; c < header.channels; c++) {
-                sum += buffer[i * header.channels + c];
-            }
-            samples[i] = sum / header.channels;
-        }
+    const char* begin = value.c_str();
+    char* end = nullptr;
+    errno = 0;
+    const long long ms = std::strtoll(begin, &end, 10);
+    if (end == begin || *end != '\0' || ms <= 0) {
+        throw std::invalid_argument("Deadline must be a positive number of milliseconds");
     }
-
-    // Resample if the sample rate is not 16000 Hz
-    // (Note: Proper resampling would require a more sophisticated approach)
-    if (header.sample_rate != 16000) {
-        std::cout << "Warning: WAV file sample rate is not 16kHz. Audio might not be processed correctly." << std::endl;
-        std::cout << "Recommend using ffmpeg to convert to 16kHz before processing." << std::endl;
+    if (errno == ERANGE || ms > MAX_DEADLINE_MS) {
+        return InferenceScheduler::Clock::time_point::max();
     }
-
-    return samples;
+    return InferenceScheduler::Clock::now() + std::chrono::milliseconds(ms);
 }
 
-// Function to transcribe audio using Whisper
-json transcribe_audio(const std::string& audio_path) {
-    // Initialize whisper parameters
-    whisper_context_params params = whisper_context_default_params();
-
-    // Initialize whisper context with params
-    struct whisper_context* ctx = whisper_init_from_file_with_params("models/ggml-base.en.bin", params);
-    if (ctx == nullptr) {
-        throw std::runtime_error("Failed to initialize whisper context");
+// Read a numeric setting from the environment
+double env_number(const char* name, double fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
     }
-
-    // Set full parameters
-    whisper_full_params full_params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
-    full_params.print_realtime = false;
-    full_params.print_progress = true;
-    full_params.translate = false;
-    full_params.language = "en";
-    full_params.n_threads = 4;
-    full_params.offset_ms = 0;
-
-    // Read audio samples
-    std::vector<float> samples;
     try {
-        samples = read_wav_file(audio_path);
-    } catch (const std::exception& e) {
-        whisper_free(ctx);
-        throw std::runtime_error(std::string("Failed to read audio: ") + e.what());
-    }
-
-    // Process the audio file
-    if (whisper_full(ctx, full_params, samples.data(), samples.size()) != 0) {
-        whisper_free(ctx);
-        throw std::runtime_error("Failed to process audio");
-    }
-
-    // Create JSON response
-    json result = json::array();
-
-    // Get the number of segments
-    const int n_segments = whisper_full_n_segments(ctx);
-
-    for (int i = 0; i < n_segments; ++i) {
-        const int64_t t0 = whisper_full_get_segment_t0(ctx, i);
-        const int64_t t1 = whisper_full_get_segment_t1(ctx, i);
-
-        // Convert timestamps to seconds
-        double time_start = t0 / 100.0;
-        double time_end = t1 / 100.0;
-
-        const char* text = whisper_full_get_segment_text(ctx, i);
-
-        json segment = {
-            {"timeStart", time_start},
-            {"timeEnd", time_end},
-            {"text", std::string(text)}
-        };
-
-        result.push_back(segment);
+        return std::stod(value);
+    } catch (const std::exception&) {
+        std::cerr << "Warning: ignoring invalid " << name << "=" << value << std::endl;
+        return fallback;
     }
-
-    whisper_free(ctx);
-    return result;
 }
 
-// Function to execute a command and get its output
-std::string exec_command(const std::string& cmd) {
-    std::array<char, 128> buffer;
-    std::string result;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
+// A TCP port number (1-65535); false for anything else
+bool parse_port(const char* value, int& port) {
+    char* end = nullptr;
+    errno = 0;
+    const long parsed = std::strtol(value, &end, 10);
+    if (end == value || *end != '\0' || errno == ERANGE || parsed < 1 || parsed > 65535) {
+        return false;
     }
-    return result;
+    port = static_cast<int>(parsed);
+    return true;
 }
 
-// Convert audio to the format Whisper expects using ffmpeg
-std::string convert_audio(const std::string& input_path, const std::string& output_path) {
-    // Use ffmpeg to convert to 16kHz mono WAV
-    std::string cmd = "ffmpeg -y -i \"" + input_path + "\" -ar 16000 -ac 1 -c:a pcm_s16le \"" + output_path + "\" 2>&1";
-
-    try {
-        std::string output = exec_command(cmd);
-        return output_path;
-    } catch (const std::exception& e) {
-        throw std::runtime_error(std::string("Failed to convert audio: ") + e.what());
+// Counts a request (or job) as in flight for as long as it lives; a drain waits for the count to reach zero
+class InFlight {
+public:
+    explicit InFlight(std::atomic<int>& count) : count_(count) { count_++; }
+    ~InFlight() { count_--; }
+    InFlight(const InFlight&) = delete;
+    InFlight& operator=(const InFlight&) = delete;
+
+private:
+    std::atomic<int>& count_;
+};
+
+// Transcription options of a queued job. Checked once at submission, so a job that
+// was accepted never fails on its options when the worker picks it up.
+TranscribeOptions job_transcribe_options(const json& stored) {
+    TranscribeOptions options;
+    options.timestamps = parse_timestamp_detail(stored.value("timestamps", ""));
+    parse_outputs(stored.value("outputs", ""), options);
+    const std::string language = stored.value("language", "");
+    if (!language.empty()) {
+        if (language != "auto" && whisper_lang_id(language.c_str()) < 0) {
+            throw std::invalid_argument("Unknown language: " + language);
+        }
+        options.language = language;
     }
+    return options;
 }
 
 int main(int argc, char** argv) {
@@ -267,15 +179,14 @@ int main(int argc, char** argv) {
         std::cout << "Transcribing file: " << audio_path << std::endl;
 
         try {
-            std::string wav_path = audio_path + ".wav";
-            convert_audio(audio_path, wav_path);
-            json result = transcribe_audio(wav_path);
+            WhisperEngine::Config config;
+            config.warm_up = false;
+            WhisperEngine engine(config);
+            engine.set_model(engine.load_model());
+            json result = engine.transcribe_file(audio_path, engine.options())["segments"];
 
-            // Print result to console
-            std::cout << result.dump(2) << std::endl;
-
-            // Clean up temp file
-            std::remove(wav_path.c_str());
+            // Print result to console, as the segments array (same as whisper_cli)
+            std::cout << result.dump(2, ' ', false, json::error_handler_t::replace) << std::endl;
 
             return 0;
         } catch (const std::exception& e) {
@@ -284,9 +195,124 @@ int main(int argc, char** argv) {
         }
     }
 
+    // --port N or PORT, so several instances (e.g. local workers for a coordinator) can share a host.
+    // Checked before any thread starts, so a bad value exits cleanly.
+    int port = 8080;
+    const char* port_env = std::getenv("PORT");
+    if (port_env != nullptr && *port_env != '\0' && !parse_port(port_env, port)) {
+        std::cerr << "Invalid PORT: " << port_env << std::endl;
+        return 1;
+    }
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string(argv[i]) == "--port" && !parse_port(argv[i + 1], port)) {
+            std::cerr << "Invalid port: " << argv[i + 1] << std::endl;
+            std::cerr << "Usage: " << argv[0] << " [--port N]" << std::endl;
+            std::cerr << "       " << argv[0] << " --transcribe <audio_file>" << std::endl;
+            return 1;
+        }
+    }
+
     // Create HTTP server
     httplib::Server server;
 
+    // SIGHUP (reload) and SIGINT/SIGTERM (drain) are taken by a dedicated sigwait thread;
+    // block them before any other thread starts so every thread inherits the mask.
+    // SIGUSR1 is only sent by main itself, to end that thread on exit.
+    sigset_t handled_signals;
+    sigemptyset(&handled_signals);
+    sigaddset(&handled_signals, SIGHUP);
+    sigaddset(&handled_signals, SIGINT);
+    sigaddset(&handled_signals, SIGTERM);
+    sigaddset(&handled_signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &handled_signals, nullptr);
+
+    // Drain state: new work is refused once draining, and in-flight work is cancelled
+    // once shutting down (when the drain runs out of time)
+    std::atomic<bool> draining{false};
+    std::atomic<bool> shutting_down{false};
+    std::atomic<int> active_requests{0};
+    auto refuse_if_draining = [&](httplib::Response& res) {
+        if (!draining) {
+            return false;
+        }
+        res.status = 503;
+        res.set_content("Server is shutting down", "text/plain");
+        return true;
+    };
+
+    // Startup progress reported by /ready: starting, downloading, loading, warming, ready or failed
+    std::mutex startup_mutex;
+    std::string startup_phase = "starting";
+    const char* isa = std::getenv("WHISPER_ISA_SELECTED");
+    json startup_info = {{"ffmpeg", false}, {"generation", 1}, {"isa", isa != nullptr ? isa : "native"}};
+    LatencyWindow two_pass_first_text;
+    LatencyWindow two_pass_final;
+
+    // The model is loaded and warmed on a startup thread, after the model file has been checked /
+    // downloaded, and published with engine.set_model; handlers take their own reference with engine.model().
+    // Inference slots are shared by all requests, with priority classes weighted interactive > standard > batch.
+    // Decode profiles are re-read on SIGHUP.
+    WhisperEngine::Config engine_config;
+    engine_config.inference_slots = static_cast<int>(env_number("WHISPER_INFERENCE_SLOTS", 1));
+    engine_config.initial_rtf = env_number("WHISPER_RTF_ESTIMATE", 0.5);
+    engine_config.n_threads = static_cast<int>(env_number("WHISPER_THREADS", 0));
+    engine_config.warm_up = env_number("WHISPER_WARMUP", 1) != 0;
+    if (const char* path = std::getenv("WHISPER_CONTEXT_PROFILES")) engine_config.context_profiles_path = path;
+    if (const char* path = std::getenv("WHISPER_DECODE_PROFILES")) engine_config.decode_profiles_path = path;
+    if (const char* name = std::getenv("WHISPER_DECODE_PROFILE")) engine_config.default_profile = name;
+    // Optional small/quantized model for draft-then-refine requests
+    if (const char* path = std::getenv("WHISPER_DRAFT_MODEL")) engine_config.draft_model_path = path;
+    WhisperEngine engine(engine_config);
+    InferenceScheduler& scheduler = engine.scheduler();
+    ContextProfiles& context_profiles = engine.context_profiles();
+    DecodeProfiles& decode_profiles = engine.decode_profiles();
+    const auto server_start = std::chrono::steady_clock::now();
+
+    // Requests still running after this long are cancelled, freeing their slot and ffmpeg child
+    const double request_timeout = env_number("WHISPER_REQUEST_TIMEOUT", 600);
+
+    // Budget for per-request memory (on top of the model weights); requests that don't fit
+    // wait up to WHISPER_MEMORY_WAIT seconds for others to finish, then get 503
+    MemoryBudget memory_budget(static_cast<size_t>(env_number("WHISPER_MEMORY_BUDGET_MB", 0) * 1024 * 1024));
+    const auto memory_wait = std::chrono::duration_cast<MemoryBudget::Clock::duration>(
+        std::chrono::duration<double>(env_number("WHISPER_MEMORY_WAIT", 30)));
+    const size_t state_bytes = static_cast<size_t>(env_number("WHISPER_STATE_MEMORY_MB", 100) * 1024 * 1024);
+    const double min_bitrate_kbps = env_number("WHISPER_MIN_BITRATE_KBPS", 32);
+
+    // Durable asynchronous jobs, spooled next to the models so they survive redeploys
+    const char* spool_dir = std::getenv("WHISPER_SPOOL_DIR");
+    std::unique_ptr<JobQueue> jobs;
+    try {
+        jobs = std::make_unique<JobQueue>(spool_dir != nullptr ? spool_dir : "models/spool",
+                                          env_number("WHISPER_JOB_RETENTION_HOURS", 168));
+    } catch (const std::exception& e) {
+        std::cerr << "Warning: job queue disabled: " << e.what() << std::endl;
+    }
+
+    // Coordinator mode: long recordings are split and fanned out to these instances
+    std::unique_ptr<ShardCoordinator> coordinator;
+    if (const char* workers = std::getenv("WHISPER_WORKERS"); workers != nullptr && *workers != '\0') {
+        ShardCoordinator::Options shard_options;
+        shard_options.chunk_seconds = env_number("WHISPER_SHARD_SECONDS", shard_options.chunk_seconds);
+        shard_options.max_attempts = static_cast<int>(env_number("WHISPER_SHARD_ATTEMPTS", shard_options.max_attempts));
+        shard_options.hedge_factor = env_number("WHISPER_HEDGE_FACTOR", shard_options.hedge_factor);
+        shard_options.request_timeout = request_timeout;
+        coordinator = std::make_unique<ShardCoordinator>(parse_worker_list(workers), shard_options);
+        std::cout << "Coordinating " << coordinator->workers().size() << " workers" << std::endl;
+    }
+
+    // Directory whose files can be transcribed in place by path; unset disables /api/transcribe-local
+    fs::path local_root;
+    if (const char* root = std::getenv("WHISPER_LOCAL_ROOT"); root != nullptr && *root != '\0') {
+        std::error_code ec;
+        local_root = fs::canonical(root, ec);
+        if (ec) {
+            std::cerr << "Warning: WHISPER_LOCAL_ROOT " << root << " is not accessible: " << ec.message() << std::endl;
+            local_root.clear();
+        } else {
+            std::cout << "Serving local files under " << local_root.string() << std::endl;
+        }
+    }
 
 
     // Check if public directory exists
@@ -674,59 +700,270 @@ int main(int argc, char** argv) {
            res.set_content(html, "text/html");
        });
 
-    // Handle file uploads for transcription
-    server.Post("/api/transcribe", [](const httplib::Request& req, httplib::Response& res) {
+    // Handle file uploads for transcription; /api/transcribe-local takes a path under
+    // WHISPER_LOCAL_ROOT instead, so the file never passes through the HTTP stack
+    auto handle_transcribe = [&](const httplib::Request& req, httplib::Response& res) {
         // Enable CORS
         res.set_header("Access-Control-Allow-Origin", "*");
 
         // Start measuring execution time
         auto start_time = std::chrono::high_resolution_clock::now();
+        const auto received = InferenceScheduler::Clock::now();
 
-        if (!req.has_file("audio")) {
+        const std::shared_ptr<WhisperModel> model = engine.model();
+        const std::shared_ptr<WhisperModel> draft_model = engine.draft_model();
+
+        // Held by the response stream in draft mode, so a drain waits for the stream too
+        auto in_flight = std::make_shared<InFlight>(active_requests);
+        if (refuse_if_draining(res)) {
+            return;
+        }
+
+        const bool local = req.path == "/api/transcribe-local";
+        if (local && local_root.empty()) {
+            res.status = 403;
+            res.set_content("Local files are disabled (WHISPER_LOCAL_ROOT is not set)", "text/plain");
+            return;
+        }
+        if (!local && !req.has_file("audio")) {
             res.status = 400;
             res.set_content("No audio file provided", "text/plain");
             return;
         }
 
-        // Get uploaded file
-        const auto& file = req.get_file_value("audio");
-        std::cout << "Received file: " << file.filename << " (" << file.content.size() << " bytes)" << std::endl;
+        // Optional per-word / per-token timings, priority class and deadline
+        TranscribeOptions options;
+        PriorityClass priority;
+        InferenceScheduler::Clock::time_point deadline;
+        const std::string tenant = get_request_option(req, "tenant", "X-Tenant");
+        const std::string mode = get_request_option(req, "mode");
+        fs::path local_path;
+        double offset_seconds = 0.0;
+        double duration_seconds = 0.0;
+        try {
+            if (local) {
+                local_path = resolve_local_path(local_root, get_request_option(req, "path"));
+                const std::string offset_ms = get_request_option(req, "offset_ms");
+                const std::string duration_ms = get_request_option(req, "duration_ms");
+                offset_seconds = offset_ms.empty() ? 0.0 : std::max(0.0, std::stod(offset_ms) / 1000.0);
+                duration_seconds = duration_ms.empty() ? 0.0 : std::max(0.0, std::stod(duration_ms) / 1000.0);
+            }
+            if (!mode.empty() && mode != "single" && mode != "draft") {
+                throw std::invalid_argument("Unknown mode: " + mode);
+            }
+            options.timestamps = parse_timestamp_detail(get_request_option(req, "timestamps"));
+            options.profile = decode_profiles.get(get_request_option(req, "profile"));
+            parse_outputs(get_request_option(req, "outputs"), options);
+            const std::string language = get_request_option(req, "language");
+            if (!language.empty()) {
+                if (language != "auto" && whisper_lang_id(language.c_str()) < 0) {
+                    throw std::invalid_argument("Unknown language: " + language);
+                }
+                options.language = language;
+            }
+            priority = parse_priority_class(get_request_option(req, "priority", "X-Priority"));
+            deadline = parse_deadline(get_request_option(req, "deadline_ms", "X-Deadline-Ms"));
+        } catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(e.what(), "text/plain");
+            return;
+        }
+
+        if (!model) {
+            res.status = 503;
+            res.set_content("Model not loaded", "text/plain");
+            return;
+        }
+        options.context = context_profiles.get(*model, tenant);
+        if (options.needs_multilingual() && !whisper_is_multilingual(model->context())) {
+            res.status = 400;
+            res.set_content("The loaded model is English-only; translation, language detection and "
+                            "non-English transcription need a multilingual model", "text/plain");
+            return;
+        }
 
-        // Save to temporary file
-        std::string temp_path = "/tmp/audio_" + std::to_string(time(nullptr));
-        std::ofstream out(temp_path, std::ios::binary);
-        out.write(file.content.c_str(), file.content.size());
-        out.close();
+        // Draft-then-refine: the draft model's segments are streamed right away, the main model's follow
+        const bool two_pass = mode == "draft";
+        if (two_pass && !draft_model) {
+            res.status = 400;
+            res.set_content("Draft mode needs a draft model (WHISPER_DRAFT_MODEL)", "text/plain");
+            return;
+        }
+
+        // Don't spend CPU on converting a request whose deadline is already out of reach
+        try {
+            scheduler.check_admission(priority, deadline, 0.0);
+        } catch (const DeadlineError& e) {
+            res.status = 503;
+            res.set_content(
+                json({
+                    {"error", e.what()},
+                    {"priority", priority_class_name(priority)},
+                    {"estimatedWait", e.estimated_wait}
+                }).dump(),
+                "application/json"
+            );
+            return;
+        }
+
+        if (local) {
+            std::cout << "Local file: " << local_path.string() << ", priority " << priority_class_name(priority) << std::endl;
+        } else {
+            const auto& file = uploaded_file(req, "audio");
+            std::cout << "Received file: " << file.filename << " (" << file.content.size() << " bytes), priority "
+                      << priority_class_name(priority) << std::endl;
+        }
+
+        // Abandon the work when the client goes away or the request overruns its
+        // timeout (or its deadline, past which the result is useless anyway)
+        auto timeout = InferenceScheduler::Clock::now() + std::chrono::milliseconds(static_cast<int64_t>(request_timeout * 1000));
+        auto cancel = std::make_shared<CancellationToken>(req.is_connection_closed, std::min(timeout, deadline), &shutting_down);
 
         // Execution time breakdown
         double convert_time = 0.0;
-        double transcribe_time = 0.0;
         double total_time = 0.0;
 
+        // The engine records the outcome of everything from the inference on; this handler
+        // records only what fails before it
+        bool submitted = false;
+
         try {
+            // Reserve the estimated peak memory before decoding anything; held until the response is done
+            size_t upload_bytes = 0;
+            double estimated_seconds = 0.0;
+            if (local) {
+                MappedFile mapped(local_path.string());
+                estimated_seconds = estimate_audio_seconds(mapped.data(), mapped.size(), min_bitrate_kbps) - offset_seconds;
+            } else {
+                const std::string& content = uploaded_file(req, "audio").content;
+                upload_bytes = content.size();
+                estimated_seconds = estimate_audio_seconds(content.data(), content.size(), min_bitrate_kbps);
+            }
+            if (duration_seconds > 0.0) {
+                estimated_seconds = std::min(estimated_seconds, duration_seconds);
+            }
+            const size_t estimated_bytes = estimate_request_bytes(
+                upload_bytes, std::max(0.0, estimated_seconds), state_bytes, two_pass ? 2 : 1,
+                options.timestamps != TimestampDetail::None);
+            auto reservation = std::make_shared<MemoryBudget::Reservation>(
+                memory_budget.reserve(estimated_bytes, MemoryBudget::Clock::now() + memory_wait, cancel.get()));
+
             std::cout << "Converting audio file..." << std::endl;
 
             // Time the conversion step
             auto convert_start = std::chrono::high_resolution_clock::now();
 
             // Convert audio to the format Whisper expects
-            std::string wav_path = temp_path + ".wav";
-            convert_audio(temp_path, wav_path);
+            std::vector<float> samples = local
+                ? load_local_audio(local_path, offset_seconds, duration_seconds, cancel.get())
+                : decode_upload(uploaded_file(req, "audio").content, cancel.get());
 
             auto convert_end = std::chrono::high_resolution_clock::now();
             convert_time = std::chrono::duration<double>(convert_end - convert_start).count();
             std::cout << "Audio conversion completed in " << convert_time << " seconds." << std::endl;
 
-            std::cout << "Transcribing audio file..." << std::endl;
-
-            // Time the transcription step
-            auto transcribe_start = std::chrono::high_resolution_clock::now();
-
-            // Transcribe audio
-            json result = transcribe_audio(wav_path);
+            if (two_pass) {
+                // Both passes run in the response stream, as NDJSON events:
+                // "draft" per draft segment, "draftComplete", then "final" with the refined result
+                auto shared_samples = std::make_shared<std::vector<float>>(std::move(samples));
+                res.set_chunked_content_provider("application/x-ndjson",
+                    [&, model, draft_model, in_flight, reservation, shared_samples, options, priority, deadline, cancel, tenant, start_time, received, convert_time]
+                    (size_t, httplib::DataSink& sink) {
+                        auto elapsed = [&start_time]() {
+                            return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+                        };
+                        // Runs inside whisper's segment callback: partial segments may end mid
+                        // UTF-8 sequence, and dump() must not throw from there
+                        auto emit = [&sink, &cancel](const json& event) {
+                            const std::string line = event.dump(-1, ' ', false, json::error_handler_t::replace) + "\n";
+                            if (!sink.write(line.data(), line.size())) {
+                                cancel->cancel(CancelReason::ClientDisconnected);
+                            }
+                        };
+
+                        try {
+                            double first_text = -1.0;
+                            double draft_time = 0.0;
+
+                            // One slot covers both passes; the draft is a small fraction of the refine cost
+                            WhisperEngine::Request request;
+                            request.priority = priority;
+                            request.deadline = deadline;
+                            request.cancel = cancel.get();
+                            request.admission_checked = true;
+                            request.model = model;
+                            request.received = received;
+
+                            // The draft is a plain transcript. An English-only draft model drafts
+                            // "auto" requests in English and skips requests in other languages.
+                            const bool draft_multilingual = whisper_is_multilingual(draft_model->context());
+                            if (draft_multilingual || options.language == "en" || options.language == "auto") {
+                                request.draft_model = draft_model;
+                                request.draft_options = options;
+                                request.draft_options.translate = false;
+                                request.draft_options.detect_language = false;
+                                request.draft_options.transcribe = true;
+                                if (!draft_multilingual) {
+                                    request.draft_options.language = "en";
+                                }
+                                request.draft_options.context = context_profiles.get(*draft_model, tenant);
+                                request.draft_options.on_segment = [&](const json& segment) {
+                                    if (first_text < 0.0) {
+                                        first_text = elapsed();
+                                    }
+                                    emit({{"event", "draft"}, {"segment", segment}});
+                                };
+                                request.on_draft_done = [&]() {
+                                    draft_time = elapsed();
+                                    if (first_text < 0.0) {
+                                        first_text = draft_time;
+                                    }
+                                    emit({{"event", "draftComplete"}, {"timeToFirstText", first_text}, {"timeToDraft", draft_time}});
+                                };
+                            }
+
+                            json result = engine.transcribe(*shared_samples, options, request);
+                            const double final_time = elapsed();
+                            if (first_text < 0.0) {
+                                first_text = final_time;
+                            }
+                            two_pass_first_text.add(first_text);
+                            two_pass_final.add(final_time);
+
+                            result["event"] = "final";
+                            result["priority"] = priority_class_name(priority);
+                            result["executionTime"].update({
+                                {"convert", convert_time},
+                                {"timeToFirstText", first_text},
+                                {"timeToDraft", draft_time},
+                                {"timeToFinal", final_time}
+                            });
+                            emit(result);
+                        } catch (const DeadlineError& e) {
+                            emit({{"event", "error"}, {"error", e.what()}, {"estimatedWait", e.estimated_wait}});
+                        } catch (const std::exception& e) {
+                            emit({{"event", "error"}, {"error", e.what()}});
+                        }
+
+                        sink.done();
+                        return true;
+                    });
+                return;
+            }
 
-            auto transcribe_end = std::chrono::high_resolution_clock::now();
-            transcribe_time = std::chrono::duration<double>(transcribe_end - transcribe_start).count();
+            // Wait for an inference slot; the audio length is known now, so the deadline check is exact
+            std::cout << "Transcribing audio file..." << std::endl;
+            WhisperEngine::Request request;
+            request.priority = priority;
+            request.deadline = deadline;
+            request.cancel = cancel.get();
+            request.admission_checked = true;
+            request.model = model;
+            request.received = received;
+            submitted = true;
+            json result = engine.transcribe(samples, options, request);
+            const double queue_time = result["executionTime"]["queue"];
+            const double transcribe_time = result["executionTime"]["transcribe"];
 
             // Calculate total execution time
             auto end_time = std::chrono::high_resolution_clock::now();
@@ -734,28 +971,70 @@ int main(int argc, char** argv) {
 
             std::cout << "Transcription complete in " << transcribe_time << " seconds." << std::endl;
             std::cout << "Total request processing time: " << total_time << " seconds." << std::endl;
-            std::cout << "Returning " << result.size() << " segments." << std::endl;
+            if (result.contains("segments")) {
+                std::cout << "Returning " << result["segments"].size() << " segments." << std::endl;
+            }
 
             // Add execution time information to the response
-            json response = {
-                {"segments", result},
-                {"executionTime", {
-                    {"convert", convert_time},
-                    {"transcribe", transcribe_time},
-                    {"total", total_time}
-                }}
+            json response = result;
+            response["priority"] = priority_class_name(priority);
+            if (options.context) {
+                response["tenant"] = options.context->tenant;
+            }
+            if (local) {
+                // Segment times are relative to the requested range
+                response["offsetMs"] = static_cast<int64_t>(offset_seconds * 1000);
+            }
+            response["executionTime"] = {
+                {"convert", convert_time},
+                {"queue", queue_time},
+                {"transcribe", transcribe_time},
+                {"total", total_time}
             };
 
             // Return JSON response
-            res.set_content(response.dump(2), "application/json");
+            res.set_content(response.dump(2, ' ', false, json::error_handler_t::replace), "application/json");
+        } catch (const MemoryBudgetError& e) {
+            std::cerr << "Rejected " << priority_class_name(priority) << " request: " << e.what() << std::endl;
+
+            res.status = e.too_large ? 413 : 503;
+            res.set_content(json({{"error", e.what()}, {"estimatedMemory", e.estimated_bytes}}).dump(), "application/json");
+        } catch (const DeadlineError& e) {
+            std::cerr << "Rejected " << priority_class_name(priority) << " request: " << e.what() << std::endl;
+
+            res.status = 503;
+            res.set_content(
+                json({
+                    {"error", e.what()},
+                    {"priority", priority_class_name(priority)},
+                    {"estimatedWait", e.estimated_wait}
+                }).dump(),
+                "application/json"
+            );
+        } catch (const CancelledError& e) {
+            auto end_time = std::chrono::high_resolution_clock::now();
+            total_time = std::chrono::duration<double>(end_time - start_time).count();
+            if (!submitted) {
+                scheduler.record_cancellation(priority, e.reason);
+            }
 
-            // Clean up temp files
-            std::remove(temp_path.c_str());
-            std::remove(wav_path.c_str());
+            std::cerr << e.what() << " after " << total_time << " seconds." << std::endl;
+
+            res.status = 503;
+            res.set_content(
+                json({
+                    {"error", e.what()},
+                    {"executionTime", total_time}
+                }).dump(),
+                "application/json"
+            );
         } catch (const std::exception& e) {
             // Calculate time even for errors
             auto end_time = std::chrono::high_resolution_clock::now();
             total_time = std::chrono::duration<double>(end_time - start_time).count();
+            if (!submitted) {
+                scheduler.record_failure(priority);
+            }
 
             std::cerr << "Error during transcription: " << e.what() << std::endl;
             std::cerr << "Failed after " << total_time << " seconds." << std::endl;
@@ -768,47 +1047,644 @@ int main(int argc, char** argv) {
                 }).dump(),
                 "application/json"
             );
+        }
+    };
+    server.Post("/api/transcribe", handle_transcribe);
+    server.Post("/api/transcribe-local", handle_transcribe);
 
-            std::remove(temp_path.c_str());
+    // Fast language identification: only the leading window is decoded and encoded
+    server.Post("/api/detect-language", [&](const httplib::Request& req, httplib::Response& res) {
+        // Enable CORS
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+        const auto received = InferenceScheduler::Clock::now();
+        const std::shared_ptr<WhisperModel> model = engine.model();
+
+        InFlight in_flight(active_requests);
+        if (refuse_if_draining(res)) {
+            return;
+        }
+
+        if (!req.has_file("audio")) {
+            res.status = 400;
+            res.set_content("No audio file provided", "text/plain");
+            return;
+        }
+
+        PriorityClass priority;
+        InferenceScheduler::Clock::time_point deadline;
+        int top_k = LANGUAGE_TOP_K;
+        try {
+            priority = parse_priority_class(get_request_option(req, "priority", "X-Priority"));
+            deadline = parse_deadline(get_request_option(req, "deadline_ms", "X-Deadline-Ms"));
+            const std::string top_k_value = get_request_option(req, "top_k");
+            if (!top_k_value.empty()) {
+                top_k = std::max(1, std::stoi(top_k_value));
+            }
+        } catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(e.what(), "text/plain");
+            return;
         }
+
+        if (!model) {
+            res.status = 503;
+            res.set_content("Model not loaded", "text/plain");
+            return;
+        }
+        if (!whisper_is_multilingual(model->context())) {
+            res.status = 400;
+            res.set_content("The loaded model is English-only; language detection needs a multilingual model", "text/plain");
+            return;
+        }
+
+        auto timeout = InferenceScheduler::Clock::now() + std::chrono::milliseconds(static_cast<int64_t>(request_timeout * 1000));
+        CancellationToken cancel(req.is_connection_closed, std::min(timeout, deadline), &shutting_down);
+        bool submitted = false; // the engine records the outcome from here on
+
+        try {
+            scheduler.check_admission(priority, deadline, 0.0);
+
+            auto convert_start = std::chrono::high_resolution_clock::now();
+            // Only the first window is decoded, however long the upload is
+            const std::string& content = uploaded_file(req, "audio").content;
+            const double estimated_seconds = std::min<double>(
+                estimate_audio_seconds(content.data(), content.size(), min_bitrate_kbps), WHISPER_CHUNK_SIZE);
+            MemoryBudget::Reservation reservation = memory_budget.reserve(
+                estimate_request_bytes(content.size(), estimated_seconds, state_bytes, 1, false),
+                MemoryBudget::Clock::now() + memory_wait, &cancel);
+
+            std::vector<float> samples = decode_upload(content, &cancel, WHISPER_CHUNK_SIZE);
+            auto convert_end = std::chrono::high_resolution_clock::now();
+
+            WhisperEngine::Request request;
+            request.priority = priority;
+            request.deadline = deadline;
+            request.cancel = &cancel;
+            request.admission_checked = true;
+            request.model = model;
+            request.received = received;
+            submitted = true;
+            json result = engine.detect_language(samples, top_k, request);
+            const double detect_time = result["executionTime"]["detect"];
+
+            auto end_time = std::chrono::high_resolution_clock::now();
+            const double total_time = std::chrono::duration<double>(end_time - start_time).count();
+
+            std::cout << "Detected language " << result["detected"] << " in " << total_time << " seconds." << std::endl;
+
+            result["executionTime"] = {
+                {"convert", std::chrono::duration<double>(convert_end - convert_start).count()},
+                {"detect", detect_time},
+                {"total", total_time}
+            };
+            res.set_content(result.dump(2, ' ', false, json::error_handler_t::replace), "application/json");
+        } catch (const MemoryBudgetError& e) {
+            res.status = e.too_large ? 413 : 503;
+            res.set_content(json({{"error", e.what()}, {"estimatedMemory", e.estimated_bytes}}).dump(), "application/json");
+        } catch (const DeadlineError& e) {
+            res.status = 503;
+            res.set_content(json({{"error", e.what()}, {"estimatedWait", e.estimated_wait}}).dump(), "application/json");
+        } catch (const CancelledError& e) {
+            if (!submitted) {
+                scheduler.record_cancellation(priority, e.reason);
+            }
+            res.status = 503;
+            res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+        } catch (const std::exception& e) {
+            if (!submitted) {
+                scheduler.record_failure(priority);
+            }
+            std::cerr << "Error during language detection: " << e.what() << std::endl;
+            res.status = 500;
+            res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+        }
+    });
+
+    // Sharded transcription: the coordinator only decodes and splits the upload, the
+    // workers' own schedulers decide when each chunk runs
+    server.Post("/api/transcribe-sharded", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        auto start_time = std::chrono::high_resolution_clock::now();
+
+        InFlight in_flight(active_requests);
+        if (refuse_if_draining(res)) {
+            return;
+        }
+
+        if (!coordinator) {
+            res.status = 503;
+            res.set_content("No workers configured (WHISPER_WORKERS)", "text/plain");
+            return;
+        }
+        if (!req.has_file("audio")) {
+            res.status = 400;
+            res.set_content("No audio file provided", "text/plain");
+            return;
+        }
+
+        // Chunks are transcribed independently, so only options that make sense per chunk are forwarded
+        std::vector<std::pair<std::string, std::string>> fields;
+        const std::vector<std::pair<std::string, std::string>> forwarded = {
+            {"timestamps", ""}, {"language", ""}, {"profile", ""}, {"tenant", "X-Tenant"}, {"priority", "X-Priority"}
+        };
+        for (const auto& [name, header] : forwarded) {
+            const std::string value = get_request_option(req, name, header);
+            if (!value.empty()) {
+                fields.emplace_back(name, value);
+            }
+        }
+
+        auto timeout = InferenceScheduler::Clock::now() + std::chrono::milliseconds(static_cast<int64_t>(request_timeout * 1000));
+        CancellationToken cancel(req.is_connection_closed, timeout, &shutting_down);
+
+        try {
+            auto convert_start = std::chrono::high_resolution_clock::now();
+            // No whisper state here; the chunks' WAV copies take the place of the scratch WAV
+            const std::string& content = uploaded_file(req, "audio").content;
+            MemoryBudget::Reservation reservation = memory_budget.reserve(
+                estimate_request_bytes(content.size(), estimate_audio_seconds(content.data(), content.size(), min_bitrate_kbps),
+                                       0, 1, get_request_option(req, "timestamps") != ""),
+                MemoryBudget::Clock::now() + memory_wait, &cancel);
+
+            std::vector<float> samples = decode_upload(content, &cancel);
+            auto convert_end = std::chrono::high_resolution_clock::now();
+
+            json result = coordinator->transcribe(samples, fields, &cancel);
+
+            auto end_time = std::chrono::high_resolution_clock::now();
+            result["executionTime"] = {
+                {"convert", std::chrono::duration<double>(convert_end - convert_start).count()},
+                {"total", std::chrono::duration<double>(end_time - start_time).count()}
+            };
+            std::cout << "Sharded transcription of " << result["shards"].size() << " chunks complete." << std::endl;
+            res.set_content(result.dump(2, ' ', false, json::error_handler_t::replace), "application/json");
+        } catch (const MemoryBudgetError& e) {
+            res.status = e.too_large ? 413 : 503;
+            res.set_content(json({{"error", e.what()}, {"estimatedMemory", e.estimated_bytes}}).dump(), "application/json");
+        } catch (const std::invalid_argument& e) {
+            res.status = 400;
+            res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+        } catch (const CancelledError& e) {
+            res.status = 503;
+            res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+        } catch (const std::exception& e) {
+            std::cerr << "Error during sharded transcription: " << e.what() << std::endl;
+            res.status = 502;
+            res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+        }
+    });
+
+    // Asynchronous transcription: the upload is journaled before 202 is returned,
+    // and the job survives restarts until its result has been written
+    server.Post("/api/jobs", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        if (refuse_if_draining(res)) {
+            return;
+        }
+        if (!jobs) {
+            res.status = 503;
+            res.set_content("Job queue is not available", "text/plain");
+            return;
+        }
+        if (!req.has_file("audio")) {
+            res.status = 400;
+            res.set_content("No audio file provided", "text/plain");
+            return;
+        }
+
+        json options = {
+            {"timestamps", get_request_option(req, "timestamps")},
+            {"outputs", get_request_option(req, "outputs")},
+            {"language", get_request_option(req, "language")},
+            {"profile", get_request_option(req, "profile")},
+            {"tenant", get_request_option(req, "tenant", "X-Tenant")},
+            {"priority", get_request_option(req, "priority", "X-Priority")}
+        };
+        if (options["priority"] == "") {
+            options["priority"] = priority_class_name(PriorityClass::Batch);
+        }
+        try {
+            job_transcribe_options(options);
+            decode_profiles.get(options["profile"]);
+            parse_priority_class(options["priority"]);
+        } catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(e.what(), "text/plain");
+            return;
+        }
+
+        try {
+            const std::string id = jobs->submit(uploaded_file(req, "audio").content, options);
+            std::cout << "Accepted job " << id << std::endl;
+            res.status = 202;
+            res.set_header("Location", "/api/jobs/" + id);
+            res.set_content(json({{"id", id}, {"status", "queued"}}).dump(), "application/json");
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to accept job: " << e.what() << std::endl;
+            res.status = 500;
+            res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+        }
+    });
+
+    server.Get(R"(/api/jobs/([0-9a-f]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+
+        json status = jobs ? jobs->status(req.matches[1]) : json(nullptr);
+        if (status.is_null()) {
+            res.status = 404;
+            res.set_content("Unknown job", "text/plain");
+            return;
+        }
+        res.set_content(status.dump(2, ' ', false, json::error_handler_t::replace), "application/json");
     });
 
-    // Health check endpoint
+    // Scheduler metrics: per-class queue depth, latency percentiles and throughput
+    server.Get("/metrics", [&](const httplib::Request&, httplib::Response& res) {
+        json metrics = {
+            {"uptime", std::chrono::duration<double>(std::chrono::steady_clock::now() - server_start).count()},
+            {"scheduler", scheduler.metrics()},
+            {"memory", memory_budget.metrics()},
+            {"decodeProfiles", decode_profiles.metrics()},
+            {"jobs", jobs ? jobs->metrics() : json(nullptr)},
+            {"coordinator", coordinator ? coordinator->metrics() : json(nullptr)},
+            {"twoPass", {
+                {"timeToFirstText", two_pass_first_text.summary()},
+                {"timeToFinal", two_pass_final.summary()}
+            }}
+        };
+        res.set_content(metrics.dump(2), "application/json");
+    });
+
+    // Health check endpoint (liveness: the process is up, whatever the startup phase)
     server.Get("/health", [](const httplib::Request&, httplib::Response& res) {
         res.set_content("{\"status\":\"ok\"}", "application/json");
     });
 
-    // Make sure the models directory exists
-    if (!fs::exists("models")) {
-        std::cerr << "Models directory not found. Creating..." << std::endl;
-        fs::create_directory("models");
-    }
+    // Readiness: 200 only once the model is warm, ffmpeg works and the queue is short enough,
+    // so a load balancer keeps traffic away from instances that can't serve it quickly
+    const double ready_max_wait = env_number("WHISPER_READY_MAX_WAIT", 0);
+    server.Get("/ready", [&](const httplib::Request&, httplib::Response& res) {
+        json status;
+        std::string phase;
+        {
+            std::lock_guard<std::mutex> lock(startup_mutex);
+            phase = startup_phase;
+            status = startup_info;
+        }
+
+        const json scheduler_metrics = scheduler.metrics();
+        const double estimated_wait = scheduler.estimated_wait(PriorityClass::Standard);
+        const bool overloaded = ready_max_wait > 0 && estimated_wait > ready_max_wait;
+        const bool ready = phase == "ready" && !overloaded && !draining;
+
+        status["status"] = draining ? "draining" : ready ? "ready" : (phase == "ready" ? "overloaded" : phase);
+        status["slots"] = scheduler_metrics["slots"];
+        status["busy"] = scheduler_metrics["busy"];
+        status["queued"] = scheduler_metrics["queued"];
+        status["estimatedWait"] = estimated_wait;
+
+        res.status = ready ? 200 : 503;
+        res.set_content(status.dump(), "application/json");
+    });
+
+    auto set_startup_phase = [&](const std::string& phase) {
+        std::lock_guard<std::mutex> lock(startup_mutex);
+        startup_phase = phase;
+        std::cout << "Startup: " << phase << std::endl;
+    };
 
-    // Check if model exists
-    if (!fs::exists("models/ggml-base.en.bin")) {
-        std::cout << "Model not found. Attempting to download..." << std::endl;
-        if (!download_model("ggml-base.en.bin")) {
-            std::cerr << "Please download manually using:" << std::endl;
-            std::cerr << "curl -L https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-base.en.bin -o models/ggml-base.en.bin" << std::endl;
+    // Download, load and warm the models while the server already answers /health and /ready
+    std::promise<void> startup_promise;
+    std::shared_future<void> startup_done = startup_promise.get_future().share();
+    std::thread startup([&]() {
+        const auto startup_begin = std::chrono::steady_clock::now();
+
+        // Make sure the models directory exists
+        if (!fs::exists("models")) {
+            std::cerr << "Models directory not found. Creating..." << std::endl;
+            fs::create_directory("models");
         }
-    }
 
-    // Check if ffmpeg is installed
-    try {
-        exec_command("ffmpeg -version");
-    } catch (const std::exception&) {
-        std::cerr << "Warning: ffmpeg not found. Audio conversion will not work." << std::endl;
-        std::cerr << "Please install ffmpeg to enable audio file processing." << std::endl;
+        // Check if model exists
+        if (!fs::exists("models/ggml-base.en.bin")) {
+            set_startup_phase("downloading");
+            std::cout << "Model not found. Attempting to download..." << std::endl;
+            if (!download_model("ggml-base.en.bin")) {
+                std::cerr << "Please download manually using:" << std::endl;
+                std::cerr << "curl -L https://huggingface.co/ggerganov/whisper.cpp/resolve/main/ggml-base.en.bin -o models/ggml-base.en.bin" << std::endl;
+            }
+        }
+
+        // Load the model once; every request shares its weights
+        set_startup_phase("loading");
+        std::string error;
+        std::shared_ptr<WhisperModel> model;
+        try {
+            model = engine.open_model();
+        } catch (const std::exception& e) {
+            error = e.what();
+            std::cerr << error << ". Transcription requests will fail." << std::endl;
+        }
+
+        // Check if ffmpeg is installed
+        const bool has_ffmpeg = ffmpeg_available();
+        if (!has_ffmpeg) {
+            std::cerr << "Warning: ffmpeg not found. Audio conversion will not work." << std::endl;
+            std::cerr << "Please install ffmpeg to enable audio file processing." << std::endl;
+        }
+
+        // Threads per inference: WHISPER_THREADS, or the fastest on this host with the
+        // configured number of concurrent inferences sharing its cores
+        std::shared_ptr<WhisperModel> draft_model;
+        if (model) {
+            if (engine_config.warm_up) {
+                set_startup_phase("warming");
+            }
+            auto warm_start = std::chrono::steady_clock::now();
+            try {
+                engine.warm_up(*model);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            try {
+                draft_model = engine.load_draft_model(model->n_threads());
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << ". Draft mode is disabled." << std::endl;
+            }
+            if (engine_config.warm_up) {
+                std::lock_guard<std::mutex> lock(startup_mutex);
+                startup_info["warmupSeconds"] = std::chrono::duration<double>(std::chrono::steady_clock::now() - warm_start).count();
+            }
+            std::cout << "Using " << model->n_threads() << " threads per inference" << std::endl;
+        }
+        if (error.empty() && !has_ffmpeg) {
+            error = "ffmpeg not found";
+        }
+
+        engine.set_model(model);
+        engine.set_draft_model(draft_model);
+        {
+            std::lock_guard<std::mutex> lock(startup_mutex);
+            startup_info["ffmpeg"] = has_ffmpeg;
+            startup_info["threads"] = model ? model->n_threads() : 0;
+            startup_info["draftModel"] = draft_model != nullptr;
+            startup_info["startupSeconds"] = std::chrono::duration<double>(std::chrono::steady_clock::now() - startup_begin).count();
+            if (!error.empty()) {
+                startup_info["error"] = error;
+            }
+        }
+        set_startup_phase(error.empty() ? "ready" : "failed");
+        startup_promise.set_value();
+    });
+
+    // Hot reload: a new model generation is loaded and warmed off the request path, then
+    // swapped in atomically. Requests keep the generation they started with; the old one
+    // is freed when its last reference goes away.
+    std::mutex reload_mutex;
+    std::condition_variable reload_cv;
+    bool reload_pending = false;
+    bool reload_stop = false;
+    std::string reload_path;
+    int model_generation = 1;
+
+    // False when a reload is already queued or running
+    auto request_reload = [&](const std::string& path) {
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        if (reload_pending) {
+            return false;
+        }
+        reload_pending = true;
+        reload_path = path;
+        reload_cv.notify_all();
+        return true;
+    };
+
+    std::thread reloader([&]() {
+        startup_done.wait();
+        std::unique_lock<std::mutex> lock(reload_mutex);
+        while (true) {
+            reload_cv.wait(lock, [&] { return reload_pending || reload_stop; });
+            if (reload_stop) {
+                break;
+            }
+            const std::string requested = reload_path;
+            lock.unlock();
+
+            const auto reload_start = std::chrono::steady_clock::now();
+            const std::shared_ptr<WhisperModel> current = engine.model();
+            const std::string path = !requested.empty() ? requested : (current ? current->path() : engine_config.model_path);
+            std::cout << "Loading model generation " << model_generation + 1 << " from " << path << std::endl;
+
+            // The new generation keeps the current thread count rather than re-tuning
+            std::string error;
+            std::shared_ptr<WhisperModel> model;
+            try {
+                model = engine.load_model(path, current ? current->n_threads() : 0);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+
+            {
+                std::lock_guard<std::mutex> info_lock(startup_mutex);
+                if (error.empty()) {
+                    engine.set_model(model);
+                    model_generation++;
+                    startup_info["generation"] = model_generation;
+                    startup_info["threads"] = model->n_threads();
+                    // A model that failed to load at startup may have been fixed by this reload
+                    if (startup_info["ffmpeg"] == true) {
+                        startup_info.erase("error");
+                        startup_phase = "ready";
+                    }
+                }
+                startup_info["lastReload"] = {
+                    {"model", path},
+                    {"seconds", std::chrono::duration<double>(std::chrono::steady_clock::now() - reload_start).count()},
+                    {"error", error.empty() ? json(nullptr) : json(error)}
+                };
+            }
+            if (error.empty()) {
+                std::cout << "Switched to model generation " << model_generation << std::endl;
+            } else {
+                std::cerr << "Reload failed, keeping the current model: " << error << std::endl;
+            }
+
+            lock.lock();
+            reload_pending = false;
+        }
+    });
+
+    // Reload the model (optionally from another file); protected by WHISPER_ADMIN_TOKEN, disabled without it
+    const char* admin_token_env = std::getenv("WHISPER_ADMIN_TOKEN");
+    const std::string admin_token = admin_token_env != nullptr ? admin_token_env : "";
+    server.Post("/admin/reload", [&](const httplib::Request& req, httplib::Response& res) {
+        if (admin_token.empty() || req.get_header_value("X-Admin-Token") != admin_token) {
+            res.status = 403;
+            res.set_content("Forbidden", "text/plain");
+            return;
+        }
+        if (!request_reload(get_request_option(req, "model"))) {
+            res.status = 409;
+            res.set_content("A reload is already in progress", "text/plain");
+            return;
+        }
+        res.status = 202;
+        res.set_content(json({{"status", "reloading"}}).dump(), "application/json");
+    });
+
+    // SIGHUP reloads; SIGINT/SIGTERM stop taking work, let in-flight requests and the running
+    // jobs finish within WHISPER_DRAIN_TIMEOUT, cancel whatever is left, then stop the server.
+    // Queued jobs stay in the journal and resume on the next start.
+    const double drain_timeout = env_number("WHISPER_DRAIN_TIMEOUT", 25);
+    std::thread signal_thread([&, handled_signals]() {
+        while (true) {
+            int sig = 0;
+            if (sigwait(&handled_signals, &sig) != 0) {
+                continue;
+            }
+            if (sig == SIGUSR1) {
+                return;
+            }
+            if (sig == SIGHUP) {
+                std::cout << "SIGHUP: reloading model and decode profiles" << std::endl;
+                decode_profiles.reload();
+                request_reload("");
+                continue;
+            }
+
+            std::cout << "Received signal " << sig << ", draining " << active_requests << " requests..." << std::endl;
+            draining = true;
+            if (jobs) {
+                jobs->stop();
+            }
+            engine.stop_waiting();
+
+            const auto drain_deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(drain_timeout);
+            while (active_requests > 0 && std::chrono::steady_clock::now() < drain_deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            if (active_requests > 0) {
+                std::cerr << "Drain timed out; cancelling " << active_requests << " requests." << std::endl;
+                shutting_down = true;
+            }
+            server.stop();
+            return;
+        }
+    });
+
+    // Job workers go through the same scheduler as requests, as batch work by default
+    auto run_job = [&](const JobQueue::Job& job) {
+        const PriorityClass priority = parse_priority_class(job.options.value("priority", ""));
+        CancellationToken cancel(nullptr, InferenceScheduler::Clock::time_point::max(), &shutting_down);
+        auto start_time = std::chrono::high_resolution_clock::now();
+        const auto received = InferenceScheduler::Clock::now();
+        const std::shared_ptr<WhisperModel> model = engine.model();
+        InFlight in_flight(active_requests);
+        bool submitted = false; // the engine records the outcome from here on
+        try {
+            if (!model) {
+                throw std::runtime_error("Model not loaded");
+            }
+            TranscribeOptions options = job_transcribe_options(job.options);
+            options.context = context_profiles.get(*model, job.options.value("tenant", ""));
+            options.profile = decode_profiles.get(job.options.value("profile", ""));
+
+            // Jobs wait for memory as long as it takes; the upload is read from the spool, not held in memory
+            double estimated_seconds = 0.0;
+            {
+                MappedFile upload(jobs->upload_path(job.id));
+                estimated_seconds = estimate_audio_seconds(upload.data(), upload.size(), min_bitrate_kbps);
+            }
+            MemoryBudget::Reservation reservation = memory_budget.reserve(
+                estimate_request_bytes(0, estimated_seconds, state_bytes, 1, options.timestamps != TimestampDetail::None),
+                MemoryBudget::Clock::time_point::max(), &cancel);
+
+            ScratchFile wav("audio.wav");
+            convert_audio(jobs->upload_path(job.id), wav.path(), &cancel, {wav.fd()});
+            std::vector<float> samples = read_wav_file(wav.path());
+
+            WhisperEngine::Request request;
+            request.priority = priority;
+            request.cancel = &cancel;
+            request.model = model;
+            request.received = received;
+            submitted = true;
+            json result = engine.transcribe(samples, options, request);
+
+            const double total_time = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start_time).count();
+            result["executionTime"]["total"] = total_time;
+            jobs->complete(job.id, result);
+            std::cout << "Job " << job.id << " done in " << total_time << " seconds." << std::endl;
+        } catch (const CancelledError& e) {
+            // Still journaled as running, so it is picked up again after the restart
+            if (!submitted) {
+                scheduler.record_cancellation(priority, e.reason);
+            }
+            std::cerr << "Job " << job.id << " interrupted; it resumes on the next start." << std::endl;
+        } catch (const std::exception& e) {
+            if (!submitted) {
+                scheduler.record_failure(priority);
+            }
+            std::cerr << "Job " << job.id << " failed: " << e.what() << std::endl;
+            jobs->fail(job.id, e.what());
+        }
+    };
+
+    std::vector<std::thread> job_workers;
+    if (jobs) {
+        const int worker_count = std::max(1, static_cast<int>(env_number("WHISPER_JOB_WORKERS", 1)));
+        for (int i = 0; i < worker_count; ++i) {
+            job_workers.emplace_back([&]() {
+                // Leave jobs queued (rather than failing them) until there is a model to run them;
+                // when the startup load fails, that is the first successful /admin/reload
+                if (!engine.wait_for_model()) {
+                    return;
+                }
+                JobQueue::Job job;
+                while (jobs->next(job)) {
+                    try {
+                        run_job(job);
+                    } catch (const std::exception& e) {
+                        // Journal failures: the job is replayed on the next start
+                        std::cerr << "Job " << job.id << " could not be recorded: " << e.what() << std::endl;
+                    }
+                }
+            });
+        }
     }
 
-    std::cout << "Starting server on http://localhost:8080" << std::endl;
-    std::cout << "Visit http://localhost:8080 in your browser to use the web interface" << std::endl;
+    std::cout << "Starting server on http://localhost:" << port << std::endl;
+    std::cout << "Visit http://localhost:" << port << " in your browser to use the web interface" << std::endl;
 
     // Start the server with built-in error handling
-    if (!server.listen("0.0.0.0", 8080)) {
+    if (!server.listen("0.0.0.0", port)) {
         std::cerr << "Failed to start server!" << std::endl;
     }
 
+    // The signal thread uses main's locals; it has returned already unless the server stopped
+    // without a signal (e.g. listen failed)
+    pthread_kill(signal_thread.native_handle(), SIGUSR1);
+    signal_thread.join();
+
+    if (jobs) {
+        jobs->stop();
+    }
+    engine.stop_waiting();
+    for (auto& worker : job_workers) {
+        worker.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(reload_mutex);
+        reload_stop = true;
+    }
+    reload_cv.notify_all();
+    reloader.join();
+    startup.join();
+
 
     return 0;
 }
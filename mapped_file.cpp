@@ -0,0 +1,56 @@
+#include "mapped_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to stat " + path + ": " + std::strerror(errno));
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    if (size_ > 0) {
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Failed to map " + path + ": " + std::strerror(errno));
+        }
+        data_ = static_cast<const char*>(mapped);
+    }
+
+    // The mapping keeps the file referenced
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+}
+
+void MappedFile::advise_sequential(size_t offset, size_t length) const {
+    if (data_ == nullptr || offset >= size_) {
+        return;
+    }
+
+    // madvise needs a page-aligned start
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t aligned = offset - offset % page;
+    length = std::min(length + (offset - aligned), size_ - aligned);
+    char* start = const_cast<char*>(data_) + aligned;
+    madvise(start, length, MADV_SEQUENTIAL);
+    madvise(start, length, MADV_WILLNEED);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are only faulted in when touched,
+// so reading a small range of a large recording costs that range, not the file size.
+class MappedFile {
+public:
+    // Throws std::runtime_error when the file can't be opened or mapped
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+    // Hint that [offset, offset + length) will be read sequentially
+    void advise_sequential(size_t offset, size_t length) const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,142 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+constexpr double SAMPLE_RATE = 16000.0;
+
+// JSON result per audio second: segment objects, plus per-word columns with timestamps
+constexpr size_t JSON_BYTES_PER_SECOND = 1024;
+constexpr size_t TIMESTAMP_JSON_BYTES_PER_SECOND = 4096;
+
+} // namespace
+
+double estimate_audio_seconds(const char* data, size_t size, double min_bitrate_kbps) {
+    auto read_u32 = [data](size_t at) { uint32_t v; std::memcpy(&v, data + at, 4); return v; };
+
+    if (size >= 12 && std::memcmp(data, "RIFF", 4) == 0 && std::memcmp(data + 8, "WAVE", 4) == 0) {
+        uint32_t byte_rate = 0;
+        size_t pos = 12;
+        while (pos + 8 <= size) {
+            const uint32_t chunk_size = read_u32(pos + 4);
+            if (std::memcmp(data + pos, "fmt ", 4) == 0 && pos + 20 <= size) {
+                byte_rate = read_u32(pos + 16);
+            } else if (std::memcmp(data + pos, "data", 4) == 0 && byte_rate > 0) {
+                // Streamed WAVs leave the size unset; the rest of the upload is the data then
+                const size_t available = size - (pos + 8);
+                const size_t data_size = chunk_size == 0 || chunk_size == 0xFFFFFFFF ? available
+                                                                                     : std::min<size_t>(chunk_size, available);
+                return static_cast<double>(data_size) / byte_rate;
+            }
+            pos += 8 + chunk_size + (chunk_size & 1);
+        }
+    }
+
+    return size * 8.0 / (min_bitrate_kbps * 1000.0);
+}
+
+size_t estimate_request_bytes(size_t upload_bytes, double audio_seconds, size_t state_bytes, int model_passes,
+                              bool timestamps) {
+    const double samples = audio_seconds * SAMPLE_RATE;
+
+    // Upload body + its scratch copy; 16-bit WAV scratch + read buffer; float samples
+    const double audio = 2.0 * upload_bytes + samples * (2 + 2 + 4);
+    const double result = audio_seconds * (timestamps ? TIMESTAMP_JSON_BYTES_PER_SECOND : JSON_BYTES_PER_SECOND);
+    return static_cast<size_t>(audio + result) + state_bytes * static_cast<size_t>(std::max(1, model_passes));
+}
+
+size_t current_rss_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0;
+    size_t resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) {
+        return 0;
+    }
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+size_t peak_rss_bytes() {
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+
+void reset_peak_rss() {
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    clear_refs << "5";
+}
+
+MemoryBudget::Reservation::~Reservation() {
+    if (budget_ != nullptr) {
+        budget_->release(bytes_);
+    }
+}
+
+MemoryBudget::Reservation MemoryBudget::reserve(size_t bytes, Clock::time_point wait_until, CancellationToken* cancel) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (budget_ == 0) {
+        admitted_++;
+        return Reservation(nullptr, bytes);
+    }
+
+    if (bytes > budget_) {
+        rejected_++;
+        throw MemoryBudgetError("Request needs an estimated " + std::to_string(bytes >> 20) + " MB, more than the " +
+                                std::to_string(budget_ >> 20) + " MB memory budget", bytes, true);
+    }
+
+    if (reserved_ + bytes > budget_) {
+        deferred_++;
+        while (reserved_ + bytes > budget_) {
+            if (cancel != nullptr && cancel->cancelled()) {
+                throw CancelledError(cancel->reason());
+            }
+            if (Clock::now() >= wait_until) {
+                rejected_++;
+                throw MemoryBudgetError("Memory budget exhausted: " + std::to_string(reserved_ >> 20) + " of " +
+                                        std::to_string(budget_ >> 20) + " MB reserved", bytes, false);
+            }
+            // Poll so cancellation and the wait deadline are noticed while nothing is released
+            cv_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+
+    reserved_ += bytes;
+    peak_reserved_ = std::max(peak_reserved_, reserved_);
+    admitted_++;
+    return Reservation(this, bytes);
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        reserved_ -= bytes;
+    }
+    cv_.notify_all();
+}
+
+json MemoryBudget::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return {
+        {"budget", budget_},
+        {"reserved", reserved_},
+        {"peakReserved", peak_reserved_},
+        {"rss", current_rss_bytes()},
+        {"peakRss", peak_rss_bytes()},
+        {"admitted", admitted_},
+        {"deferred", deferred_},
+        {"rejected", rejected_}
+    };
+}
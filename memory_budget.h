@@ -0,0 +1,86 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include "cancellation.h"
+#include "nlohmann/json.hpp"
+
+// Raised when a request's estimated footprint doesn't fit the memory budget
+class MemoryBudgetError : public std::runtime_error {
+public:
+    MemoryBudgetError(const std::string& what, size_t estimated_bytes, bool too_large)
+        : std::runtime_error(what), estimated_bytes(estimated_bytes), too_large(too_large) {}
+
+    size_t estimated_bytes;
+    bool too_large; // larger than the whole budget; waiting can't help
+};
+
+// Audio length of an upload before decoding: exact for WAV (from the header), otherwise
+// an upper bound assuming the upload is encoded at no less than min_bitrate_kbps
+double estimate_audio_seconds(const char* data, size_t size, double min_bitrate_kbps);
+
+// Peak memory of one request: the upload and its scratch copy, the decoded WAV and the
+// float samples, whisper_state buffers (per model pass), and the JSON result
+size_t estimate_request_bytes(size_t upload_bytes, double audio_seconds, size_t state_bytes, int model_passes,
+                              bool timestamps);
+
+// Resident set size of this process, from /proc/self/statm (0 where unavailable)
+size_t current_rss_bytes();
+
+// High-water mark of the resident set size, from VmHWM in /proc/self/status (0 where unavailable)
+size_t peak_rss_bytes();
+
+// Restart the high-water mark from the current RSS (Linux 4.0+), to measure one phase at a time
+void reset_peak_rss();
+
+// Global budget for per-request memory, on top of the resident model weights.
+// Requests reserve their estimated footprint before decoding; a request that doesn't fit
+// waits for others to release theirs, up to a deadline, and is rejected after that.
+class MemoryBudget {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Released on destruction
+    class Reservation {
+    public:
+        Reservation(MemoryBudget* budget, size_t bytes) : budget_(budget), bytes_(bytes) {}
+        Reservation(Reservation&& other) noexcept : budget_(other.budget_), bytes_(other.bytes_) { other.budget_ = nullptr; }
+        Reservation(const Reservation&) = delete;
+        Reservation& operator=(const Reservation&) = delete;
+        Reservation& operator=(Reservation&&) = delete;
+        ~Reservation();
+
+        size_t bytes() const { return bytes_; }
+
+    private:
+        MemoryBudget* budget_;
+        size_t bytes_;
+    };
+
+    // budget_bytes == 0 disables the budget: every reservation is granted immediately
+    explicit MemoryBudget(size_t budget_bytes) : budget_(budget_bytes) {}
+
+    // Block until bytes fit. Throws MemoryBudgetError when they never can or wait_until
+    // passes, and CancelledError if the token is cancelled while waiting.
+    Reservation reserve(size_t bytes, Clock::time_point wait_until, CancellationToken* cancel = nullptr);
+
+    // Budget, live and peak reservations next to actual and peak RSS, for calibrating the estimates
+    nlohmann::json metrics() const;
+
+private:
+    void release(size_t bytes);
+
+    const size_t budget_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t reserved_ = 0;
+    size_t peak_reserved_ = 0;
+    uint64_t admitted_ = 0;
+    uint64_t deferred_ = 0;
+    uint64_t rejected_ = 0;
+};
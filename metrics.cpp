@@ -0,0 +1,42 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace {
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+} // namespace
+
+void LatencyWindow::add(double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    samples_.push_back(seconds);
+    if (samples_.size() > capacity_) {
+        samples_.pop_front();
+    }
+    count_++;
+}
+
+nlohmann::json LatencyWindow::summary() const {
+    std::vector<double> sorted;
+    uint64_t count;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sorted.assign(samples_.begin(), samples_.end());
+        count = count_;
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    return {
+        {"count", count},
+        {"p50", percentile(sorted, 0.50)},
+        {"p95", percentile(sorted, 0.95)},
+        {"p99", percentile(sorted, 0.99)},
+        {"max", sorted.empty() ? 0.0 : sorted.back()}
+    };
+}
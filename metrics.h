@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include "nlohmann/json.hpp"
+
+// Recent latency samples (seconds) for percentile reporting. Thread-safe.
+class LatencyWindow {
+public:
+    explicit LatencyWindow(size_t capacity = 512) : capacity_(capacity) {}
+
+    void add(double seconds);
+
+    // {"count", "p50", "p95", "p99", "max"}; count covers every sample ever added
+    nlohmann::json summary() const;
+
+private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::deque<double> samples_;
+    uint64_t count_ = 0;
+};
@@ -0,0 +1,45 @@
+#!/bin/bash
+# pgo.sh — profile-guided build: instrumented build, training run, optimized rebuild
+
+if [ -z "$1" ]; then
+  echo "Usage: ./pgo.sh <build_dir> [cmake options...]"
+  echo "  Trains on SAMPLES (default: whisper.cpp/samples) with the model under ./models"
+  exit 1
+fi
+
+set -e
+
+SRC_DIR="$(cd "$(dirname "$0")" && pwd)"
+BUILD_DIR="$1"
+shift
+PROFILE_DIR="$(mkdir -p "$BUILD_DIR" && cd "$BUILD_DIR" && pwd)/pgo"
+SAMPLES="${SAMPLES:-$SRC_DIR/whisper.cpp/samples}"
+
+# 1. Instrumented build. The same build directory is reused for the optimized build,
+#    since GCC looks profiles up by object file path.
+rm -rf "$PROFILE_DIR"
+cmake -S "$SRC_DIR" -B "$BUILD_DIR" -DCMAKE_BUILD_TYPE=Release \
+  -DWHISPER_SERVICE_PGO=GENERATE -DWHISPER_SERVICE_PGO_DIR="$PROFILE_DIR" "$@"
+cmake --build "$BUILD_DIR" -j"$(nproc)" --clean-first --target whisper_cli
+
+# 2. Training run: the CLI goes through the same engine, audio and ggml code as the service
+TRAINED=0
+for sample in "$SAMPLES"/*.wav "$SAMPLES"/*.mp3; do
+  [ -f "$sample" ] || continue
+  echo "Training on $sample"
+  (cd "$SRC_DIR" && "$BUILD_DIR/whisper_cli" "$sample" /dev/null)
+  TRAINED=$((TRAINED + 1))
+done
+if [ "$TRAINED" -eq 0 ]; then
+  echo "Error: no training samples in $SAMPLES"
+  exit 1
+fi
+
+# Clang writes raw profiles that have to be merged first
+if ls "$PROFILE_DIR"/*.profraw > /dev/null 2>&1; then
+  llvm-profdata merge -output="$PROFILE_DIR/default.profdata" "$PROFILE_DIR"/*.profraw
+fi
+
+# 3. Optimized rebuild of everything from the collected profiles
+cmake -S "$SRC_DIR" -B "$BUILD_DIR" -DWHISPER_SERVICE_PGO=USE "$@"
+cmake --build "$BUILD_DIR" -j"$(nproc)" --clean-first
@@ -0,0 +1,362 @@
+// whisper_regress: runs a manifest of reference clips through the engine under each
+// configuration (model, decode profile, threads), measures WER/CER, real-time factor,
+// latency percentiles and peak RSS, and compares them with a stored baseline.
+//
+//   whisper_regress [--manifest regress/manifest.json] [--baseline regress/baseline.json]
+//                   [--output results.json] [--config NAME] [--update-baseline]
+//
+// Exit status: 0 when nothing regressed beyond the baseline's tolerances, 1 on a
+// regression, 2 when the run itself failed or a baselined configuration has no recorded
+// figures to check against.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "audio.h"
+#include "engine.h"
+#include "memory_budget.h"
+#include "metrics.h"
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Clip {
+    std::string name;
+    std::string reference;
+    std::vector<float> samples;
+};
+
+// Absolute increase allowed for error rates, relative increase for the speed and memory figures
+const json DEFAULT_TOLERANCES = {
+    {"wer", 0.01},
+    {"cer", 0.01},
+    {"realTimeFactor", 0.20},
+    {"latencyP95", 0.25},
+    {"peakRss", 0.10}
+};
+
+json read_json(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open " + path);
+    }
+    return json::parse(file);
+}
+
+// Lowercase words without punctuation, so the error rates count wording differences only
+std::vector<std::string> normalize_words(const std::string& text) {
+    std::vector<std::string> words;
+    std::string word;
+    for (char c : text) {
+        const unsigned char u = static_cast<unsigned char>(c);
+        if (std::isalnum(u) || c == '\'' || u >= 0x80) {
+            word += static_cast<char>(std::tolower(u));
+        } else if (!word.empty()) {
+            words.push_back(word);
+            word.clear();
+        }
+    }
+    if (!word.empty()) {
+        words.push_back(word);
+    }
+    return words;
+}
+
+// Levenshtein distance: substitutions, insertions and deletions
+template <typename Sequence>
+size_t edit_distance(const Sequence& reference, const Sequence& hypothesis) {
+    std::vector<size_t> previous(hypothesis.size() + 1);
+    std::vector<size_t> current(hypothesis.size() + 1);
+    for (size_t j = 0; j <= hypothesis.size(); ++j) {
+        previous[j] = j;
+    }
+    for (size_t i = 1; i <= reference.size(); ++i) {
+        current[0] = i;
+        for (size_t j = 1; j <= hypothesis.size(); ++j) {
+            const size_t substitution = previous[j - 1] + (reference[i - 1] == hypothesis[j - 1] ? 0 : 1);
+            current[j] = std::min({substitution, previous[j] + 1, current[j - 1] + 1});
+        }
+        std::swap(previous, current);
+    }
+    return previous[hypothesis.size()];
+}
+
+std::string join_words(const std::vector<std::string>& words) {
+    std::string joined;
+    for (const auto& word : words) {
+        if (!joined.empty()) joined += ' ';
+        joined += word;
+    }
+    return joined;
+}
+
+std::string transcript_text(const json& result) {
+    std::string text;
+    for (const auto& segment : result["segments"]) {
+        text += segment["text"].get<std::string>();
+    }
+    return text;
+}
+
+// One configuration over every clip; the first repeat is scored, all are timed
+json run_configuration(const json& config, const std::vector<Clip>& clips, int repeats) {
+    WhisperEngine::Config engine_config;
+    engine_config.model_path = config.value("model", MODEL_PATH);
+    engine_config.n_threads = config.value("threads", 0);
+    engine_config.warm_up = true;
+
+    // The peak covers this configuration only: model weights, state and decoding
+    reset_peak_rss();
+    WhisperEngine engine(engine_config);
+    engine.set_model(engine.load_model());
+
+    TranscribeOptions options = engine.options(config.value("profile", ""));
+    options.language = config.value("language", options.language);
+
+    LatencyWindow latencies(clips.size() * repeats);
+    size_t word_errors = 0, reference_words = 0, char_errors = 0, reference_chars = 0;
+    double audio_seconds = 0.0, inference_seconds = 0.0;
+    json clip_results = json::array();
+
+    for (const Clip& clip : clips) {
+        const std::vector<std::string> reference = normalize_words(clip.reference);
+        for (int repeat = 0; repeat < repeats; ++repeat) {
+            const auto start = std::chrono::steady_clock::now();
+            const json result = engine.transcribe(clip.samples, options);
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            latencies.add(elapsed);
+            audio_seconds += clip.samples.size() / static_cast<double>(WHISPER_SAMPLE_RATE);
+            inference_seconds += elapsed;
+            if (repeat > 0) {
+                continue;
+            }
+
+            const std::vector<std::string> hypothesis = normalize_words(transcript_text(result));
+            const std::string reference_text = join_words(reference);
+            const size_t clip_word_errors = edit_distance(reference, hypothesis);
+            const size_t clip_char_errors = edit_distance(reference_text, join_words(hypothesis));
+            word_errors += clip_word_errors;
+            reference_words += reference.size();
+            char_errors += clip_char_errors;
+            reference_chars += reference_text.size();
+
+            clip_results.push_back({
+                {"name", clip.name},
+                {"wer", reference.empty() ? 0.0 : static_cast<double>(clip_word_errors) / reference.size()},
+                {"latency", elapsed},
+                {"hypothesis", join_words(hypothesis)}
+            });
+        }
+    }
+
+    return {
+        {"model", engine_config.model_path},
+        {"profile", options.profile.name},
+        {"threads", engine.model()->n_threads()},
+        {"wer", reference_words == 0 ? 0.0 : static_cast<double>(word_errors) / reference_words},
+        {"cer", reference_chars == 0 ? 0.0 : static_cast<double>(char_errors) / reference_chars},
+        {"realTimeFactor", audio_seconds > 0.0 ? inference_seconds / audio_seconds : 0.0},
+        {"latency", latencies.summary()},
+        {"peakRss", peak_rss_bytes()},
+        {"clips", clip_results}
+    };
+}
+
+// A recorded figure such as ("latency", "p95"); nullopt when the entry doesn't have it
+std::optional<double> figure(const json& entry, const char* key, const char* field = nullptr) {
+    const json* value = &entry;
+    for (const char* name : {key, field}) {
+        if (name == nullptr) {
+            continue;
+        }
+        if (!value->is_object() || !value->contains(name)) {
+            return std::nullopt;
+        }
+        value = &value->at(name);
+    }
+    if (!value->is_number()) {
+        return std::nullopt;
+    }
+    return value->get<double>();
+}
+
+// Figures a baseline entry needs before the gate can check its configuration; speed and
+// memory depend on the host, so they only exist once --update-baseline has run there
+std::vector<std::string> missing_figures(const json& baseline) {
+    std::vector<std::string> missing;
+    if (!figure(baseline, "wer")) missing.push_back("wer");
+    if (!figure(baseline, "cer")) missing.push_back("cer");
+    if (!figure(baseline, "realTimeFactor")) missing.push_back("realTimeFactor");
+    if (!figure(baseline, "latency", "p95")) missing.push_back("latency.p95");
+    if (!figure(baseline, "peakRss")) missing.push_back("peakRss");
+    return missing;
+}
+
+// Regressions of one configuration against its baseline entry, as messages
+std::vector<std::string> compare(const std::string& name, const json& result, const json& baseline, const json& tolerances) {
+    std::vector<std::string> regressions;
+    auto check = [&](const char* tolerance_key, bool relative, std::optional<double> value, std::optional<double> base) {
+        if (!value || !base || (relative && *base <= 0.0)) {
+            return;
+        }
+        const double tolerance = figure(tolerances, tolerance_key).value_or(0.0);
+        const double allowed = relative ? *base * (1.0 + tolerance) : *base + tolerance;
+        if (*value > allowed) {
+            regressions.push_back(name + ": " + tolerance_key + " " + std::to_string(*value) + " exceeds baseline " +
+                                  std::to_string(*base) +
+                                  (relative ? " by more than " + std::to_string(tolerance * 100) + "%"
+                                            : " + " + std::to_string(tolerance)));
+        }
+    };
+
+    check("wer", false, figure(result, "wer"), figure(baseline, "wer"));
+    check("cer", false, figure(result, "cer"), figure(baseline, "cer"));
+    check("realTimeFactor", true, figure(result, "realTimeFactor"), figure(baseline, "realTimeFactor"));
+    check("latencyP95", true, figure(result, "latency", "p95"), figure(baseline, "latency", "p95"));
+    check("peakRss", true, figure(result, "peakRss"), figure(baseline, "peakRss"));
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string manifest_path = "regress/manifest.json";
+    std::string baseline_path = "regress/baseline.json";
+    std::string output_path;
+    std::string only_config;
+    bool update_baseline = false;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--update-baseline") {
+            update_baseline = true;
+        } else if ((arg == "--manifest" || arg == "--baseline" || arg == "--output" || arg == "--config") && i + 1 < argc) {
+            const std::string value = argv[++i];
+            if (arg == "--manifest") manifest_path = value;
+            else if (arg == "--baseline") baseline_path = value;
+            else if (arg == "--output") output_path = value;
+            else only_config = value;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--manifest FILE] [--baseline FILE] [--output FILE] [--config NAME] [--update-baseline]" << std::endl;
+            return 2;
+        }
+    }
+
+    // Only the verdict and the summary go to stdout
+    std::streambuf* stdout_buffer = std::cout.rdbuf(std::cerr.rdbuf());
+    std::ostream report(stdout_buffer);
+
+    json results = json::object();
+    json tolerances = DEFAULT_TOLERANCES;
+    json baseline_configs = json::object();
+    try {
+        const json manifest = read_json(manifest_path);
+        const json baseline = fs::exists(baseline_path) ? read_json(baseline_path) : json::object();
+        if (baseline.contains("tolerances")) {
+            tolerances.update(baseline.at("tolerances"));
+        }
+        if (baseline.contains("configurations")) {
+            baseline_configs = baseline.at("configurations");
+            if (!baseline_configs.is_object()) {
+                throw std::runtime_error("\"configurations\" in " + baseline_path + " must be an object");
+            }
+        }
+        const int repeats = std::max(1, manifest.value("repeats", 3));
+
+        std::vector<Clip> clips;
+        for (const auto& entry : manifest.at("clips")) {
+            Clip clip;
+            clip.name = entry.at("name");
+            clip.reference = entry.at("reference");
+            clip.samples = load_local_audio(entry.at("audio").get<std::string>(), 0.0, 0.0);
+            clips.push_back(std::move(clip));
+        }
+
+        for (const auto& config : manifest.at("configurations")) {
+            const std::string name = config.at("name");
+            if (!only_config.empty() && name != only_config) {
+                continue;
+            }
+            // Optional configurations (e.g. quantized models) are skipped when their model isn't
+            // there; one with a baseline entry has to run, or the gate would pass without checking it
+            const std::string model = config.value("model", MODEL_PATH);
+            if (!fs::exists(model)) {
+                if (baseline_configs.contains(name)) {
+                    throw std::runtime_error(model + " not found, but " + name + " has a baseline");
+                }
+                report << name << ": skipped, " << model << " not found" << std::endl;
+                continue;
+            }
+            std::cerr << "Running configuration " << name << std::endl;
+            results[name] = run_configuration(config, clips, repeats);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+
+    std::vector<std::string> regressions;
+    std::vector<std::string> unrecorded;
+    for (auto it = results.begin(); it != results.end(); ++it) {
+        const json& result = it.value();
+        report << it.key() << ": WER " << result["wer"] << ", CER " << result["cer"]
+               << ", RTF " << result["realTimeFactor"] << ", p95 " << result["latency"]["p95"] << " s"
+               << ", peak RSS " << (result["peakRss"].get<size_t>() >> 20) << " MB";
+        if (!baseline_configs.contains(it.key())) {
+            report << " (no baseline)" << std::endl;
+            continue;
+        }
+        report << std::endl;
+        const std::vector<std::string> missing = missing_figures(baseline_configs[it.key()]);
+        if (!missing.empty()) {
+            std::string names;
+            for (const auto& name : missing) {
+                names += (names.empty() ? "" : ", ") + name;
+            }
+            unrecorded.push_back(it.key() + ": baseline has no " + names);
+            continue;
+        }
+        const std::vector<std::string> found = compare(it.key(), result, baseline_configs[it.key()], tolerances);
+        regressions.insert(regressions.end(), found.begin(), found.end());
+    }
+
+    if (!output_path.empty()) {
+        std::ofstream(output_path) << results.dump(2, ' ', false, json::error_handler_t::replace) << std::endl;
+    }
+
+    if (update_baseline) {
+        json updated = {{"tolerances", tolerances}, {"configurations", baseline_configs}};
+        for (auto it = results.begin(); it != results.end(); ++it) {
+            json entry = it.value();
+            entry.erase("clips");
+            updated["configurations"][it.key()] = entry;
+        }
+        std::ofstream(baseline_path) << updated.dump(2, ' ', false, json::error_handler_t::replace) << std::endl;
+        report << "Baseline written to " << baseline_path << std::endl;
+        return 0;
+    }
+
+    // A baselined configuration the gate can't fully check fails the run instead of passing
+    if (!unrecorded.empty()) {
+        for (const auto& entry : unrecorded) {
+            std::cerr << "Error: " << entry << std::endl;
+        }
+        std::cerr << "Record the figures on this host with --update-baseline" << std::endl;
+        return 2;
+    }
+
+    for (const auto& regression : regressions) {
+        report << "REGRESSION " << regression << std::endl;
+    }
+    report << (regressions.empty() ? "PASS" : "FAIL") << std::endl;
+    return regressions.empty() ? 0 : 1;
+}
@@ -0,0 +1,291 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+using json = nlohmann::json;
+
+namespace {
+
+// How often a queued request re-checks its cancellation token
+constexpr auto CANCEL_POLL_INTERVAL = std::chrono::milliseconds(100);
+
+// Minimum amount of work charged to a class per dispatch, so unknown-length requests still cost something
+constexpr double MIN_CHARGE_SECONDS = 1.0;
+
+double seconds_between(InferenceScheduler::Clock::time_point from, InferenceScheduler::Clock::time_point to) {
+    return std::chrono::duration<double>(to - from).count();
+}
+
+} // namespace
+
+const char* priority_class_name(PriorityClass cls) {
+    switch (cls) {
+        case PriorityClass::Interactive: return "interactive";
+        case PriorityClass::Standard: return "standard";
+        case PriorityClass::Batch: return "batch";
+    }
+    return "standard";
+}
+
+PriorityClass parse_priority_class(const std::string& name) {
+    if (name.empty() || name == "standard") return PriorityClass::Standard;
+    if (name == "interactive") return PriorityClass::Interactive;
+    if (name == "batch") return PriorityClass::Batch;
+    throw std::invalid_argument("Unknown priority class: " + name);
+}
+
+InferenceScheduler::Slot::~Slot() {
+    if (scheduler_ != nullptr) {
+        scheduler_->release(id_);
+    }
+}
+
+InferenceScheduler::InferenceScheduler(int slots, std::array<double, PRIORITY_CLASS_COUNT> weights, double initial_rtf)
+    : slots_(std::max(1, slots)), weights_(weights), started_(Clock::now()), rtf_(initial_rtf) {}
+
+double InferenceScheduler::estimate_seconds_locked(double audio_seconds) const {
+    return audio_seconds * rtf_;
+}
+
+double InferenceScheduler::estimate_wait_locked(PriorityClass cls, Clock::time_point deadline) const {
+    const auto now = Clock::now();
+
+    // Work still left on the running inferences
+    double backlog = 0.0;
+    for (const auto& running : running_) {
+        backlog += std::max(0.0, running.estimated_seconds - seconds_between(running.started, now));
+    }
+
+    // Queued work that will be served first: heavier classes, and earlier deadlines of the same class.
+    // Lighter classes only get a weighted share, so they are left out of the estimate.
+    const double weight = weights_[static_cast<size_t>(cls)];
+    for (const auto& ticket : queue_) {
+        if (ticket.granted) continue;
+        const double other_weight = weights_[static_cast<size_t>(ticket.cls)];
+        if (other_weight > weight || (ticket.cls == cls && ticket.deadline <= deadline)) {
+            backlog += ticket.estimated_seconds;
+        }
+    }
+
+    if (static_cast<int>(running_.size()) < slots_ && backlog == 0.0) {
+        return 0.0;
+    }
+    return backlog / slots_;
+}
+
+void InferenceScheduler::reject_locked(PriorityClass cls, double estimated_wait, const std::string& reason) {
+    stats_[static_cast<size_t>(cls)].rejected++;
+    throw DeadlineError(reason, estimated_wait);
+}
+
+void InferenceScheduler::check_admission(PriorityClass cls, Clock::time_point deadline, double audio_seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_[static_cast<size_t>(cls)].submitted++;
+
+    if (deadline == Clock::time_point::max()) {
+        return;
+    }
+
+    const double wait = estimate_wait_locked(cls, deadline);
+    const double finish = wait + estimate_seconds_locked(audio_seconds);
+    if (Clock::now() + std::chrono::duration<double>(finish) > deadline) {
+        reject_locked(cls, wait, "Deadline cannot be met: estimated wait " + std::to_string(wait) + "s");
+    }
+}
+
+InferenceScheduler::Slot InferenceScheduler::acquire(PriorityClass cls, Clock::time_point deadline, double audio_seconds,
+                                                     CancellationToken* cancel, bool admission_checked) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    const size_t c = static_cast<size_t>(cls);
+    if (!admission_checked) {
+        stats_[c].submitted++;
+    }
+    const bool has_deadline = deadline != Clock::time_point::max();
+    const double estimated = estimate_seconds_locked(audio_seconds);
+    const auto enqueued = Clock::now();
+
+    if (has_deadline) {
+        const double wait = estimate_wait_locked(cls, deadline);
+        if (enqueued + std::chrono::duration<double>(wait + estimated) > deadline) {
+            reject_locked(cls, wait, "Deadline cannot be met: estimated wait " + std::to_string(wait) + "s");
+        }
+    }
+
+    // A class that was idle must not bank credit for the time it didn't use
+    const bool class_active = std::any_of(queue_.begin(), queue_.end(),
+                                          [cls](const Ticket& t) { return t.cls == cls && !t.granted; });
+    if (!class_active) {
+        pass_[c] = std::max(pass_[c], virtual_time_);
+    }
+
+    const uint64_t id = next_id_++;
+    auto ticket = queue_.insert(queue_.end(), Ticket{id, cls, deadline, enqueued, estimated});
+    dispatch_locked();
+
+    // Wake up periodically to notice clients that went away while queued
+    bool cancelled = false;
+    while (!ticket->granted) {
+        auto wake = Clock::now() + CANCEL_POLL_INTERVAL;
+        if (has_deadline && deadline < wake) {
+            wake = deadline;
+        }
+        cv_.wait_until(lock, wake);
+
+        if (ticket->granted) break;
+        if (has_deadline && Clock::now() >= deadline) break;
+        if (cancel != nullptr && cancel->cancelled()) {
+            cancelled = true;
+            break;
+        }
+    }
+
+    const bool granted = ticket->granted;
+    queue_.erase(ticket);
+
+    if (cancelled) {
+        throw CancelledError(cancel->reason());
+    }
+    if (!granted) {
+        reject_locked(cls, seconds_between(enqueued, Clock::now()), "Deadline passed while queued");
+    }
+
+    const auto now = Clock::now();
+    if (has_deadline && now + std::chrono::duration<double>(estimated) > deadline) {
+        // Too late to finish in time: hand the slot straight to the next request
+        running_.remove_if([id](const Running& r) { return r.id == id; });
+        dispatch_locked();
+        reject_locked(cls, seconds_between(enqueued, now), "Deadline cannot be met after queueing");
+    }
+
+    stats_[c].started++;
+    stats_[c].queue_wait_seconds += seconds_between(enqueued, now);
+    return Slot(this, id);
+}
+
+void InferenceScheduler::dispatch_locked() {
+    bool granted_any = false;
+
+    while (static_cast<int>(running_.size()) < slots_) {
+        // Earliest-deadline ticket of every class, then the class with the lowest pass wins
+        std::array<std::list<Ticket>::iterator, PRIORITY_CLASS_COUNT> heads;
+        heads.fill(queue_.end());
+        for (auto it = queue_.begin(); it != queue_.end(); ++it) {
+            if (it->granted) continue;
+            auto& head = heads[static_cast<size_t>(it->cls)];
+            if (head == queue_.end() || it->deadline < head->deadline) {
+                head = it;
+            }
+        }
+
+        size_t best = PRIORITY_CLASS_COUNT;
+        for (size_t c = 0; c < PRIORITY_CLASS_COUNT; ++c) {
+            if (heads[c] == queue_.end()) continue;
+            if (best == PRIORITY_CLASS_COUNT || pass_[c] < pass_[best]) {
+                best = c;
+            }
+        }
+        if (best == PRIORITY_CLASS_COUNT) {
+            break;
+        }
+
+        auto ticket = heads[best];
+        ticket->granted = true;
+        virtual_time_ = pass_[best];
+        pass_[best] += std::max(ticket->estimated_seconds, MIN_CHARGE_SECONDS) / weights_[best];
+        running_.push_back(Running{ticket->id, Clock::now(), ticket->estimated_seconds});
+        granted_any = true;
+    }
+
+    if (granted_any) {
+        cv_.notify_all();
+    }
+}
+
+void InferenceScheduler::release(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    running_.remove_if([id](const Running& r) { return r.id == id; });
+    dispatch_locked();
+}
+
+void InferenceScheduler::record_completion(PriorityClass cls, double latency_seconds, double audio_seconds, double inference_seconds,
+                                           bool update_rtf) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = stats_[static_cast<size_t>(cls)];
+    stats.completed++;
+    stats.audio_seconds += audio_seconds;
+    stats.inference_seconds += inference_seconds;
+    stats.latencies.add(latency_seconds);
+
+    // Keep the real-time factor estimate tracking the host; very short clips are dominated by overhead
+    if (update_rtf && audio_seconds >= 1.0) {
+        rtf_ = 0.8 * rtf_ + 0.2 * (inference_seconds / audio_seconds);
+    }
+}
+
+void InferenceScheduler::record_failure(PriorityClass cls) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_[static_cast<size_t>(cls)].failed++;
+}
+
+void InferenceScheduler::record_cancellation(PriorityClass cls, CancelReason reason) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_[static_cast<size_t>(cls)].cancelled++;
+    if (reason == CancelReason::ClientDisconnected) {
+        cancelled_disconnected_++;
+    } else if (reason == CancelReason::Timeout) {
+        cancelled_timeout_++;
+    } else if (reason == CancelReason::Shutdown) {
+        cancelled_shutdown_++;
+    }
+}
+
+double InferenceScheduler::estimated_wait(PriorityClass cls) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return estimate_wait_locked(cls, Clock::time_point::max());
+}
+
+json InferenceScheduler::metrics() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const double uptime = seconds_between(started_, Clock::now());
+
+    json classes = json::object();
+    size_t queued_total = 0;
+    for (size_t c = 0; c < PRIORITY_CLASS_COUNT; ++c) {
+        const auto& stats = stats_[c];
+        const PriorityClass cls = static_cast<PriorityClass>(c);
+        const size_t queued = std::count_if(queue_.begin(), queue_.end(),
+                                            [cls](const Ticket& t) { return t.cls == cls && !t.granted; });
+        queued_total += queued;
+
+        classes[priority_class_name(cls)] = {
+            {"weight", weights_[c]},
+            {"queued", queued},
+            {"submitted", stats.submitted},
+            {"started", stats.started},
+            {"completed", stats.completed},
+            {"rejected", stats.rejected},
+            {"failed", stats.failed},
+            {"cancelled", stats.cancelled},
+            {"latency", stats.latencies.summary()},
+            {"averageQueueWait", stats.started > 0 ? stats.queue_wait_seconds / stats.started : 0.0},
+            {"throughput", {
+                {"requestsPerMinute", uptime > 0.0 ? stats.completed * 60.0 / uptime : 0.0},
+                {"audioSeconds", stats.audio_seconds},
+                {"inferenceSeconds", stats.inference_seconds}
+            }}
+        };
+    }
+
+    return {
+        {"slots", slots_},
+        {"busy", running_.size()},
+        {"queued", queued_total},
+        {"rtfEstimate", rtf_},
+        {"cancellations", {
+            {cancel_reason_name(CancelReason::ClientDisconnected), cancelled_disconnected_},
+            {cancel_reason_name(CancelReason::Timeout), cancelled_timeout_},
+            {cancel_reason_name(CancelReason::Shutdown), cancelled_shutdown_}
+        }},
+        {"classes", classes}
+    };
+}
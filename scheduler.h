@@ -0,0 +1,138 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include "cancellation.h"
+#include "metrics.h"
+#include "nlohmann/json.hpp"
+
+// Request priority classes, highest first
+enum class PriorityClass {
+    Interactive = 0,
+    Standard = 1,
+    Batch = 2
+};
+
+constexpr size_t PRIORITY_CLASS_COUNT = 3;
+
+const char* priority_class_name(PriorityClass cls);
+
+// Throws std::invalid_argument for unknown names; empty selects Standard
+PriorityClass parse_priority_class(const std::string& name);
+
+// Raised when a request is turned away because it can't finish before its deadline
+class DeadlineError : public std::runtime_error {
+public:
+    DeadlineError(const std::string& what, double estimated_wait)
+        : std::runtime_error(what), estimated_wait(estimated_wait) {}
+
+    double estimated_wait;
+};
+
+// Gates whisper inference to a fixed number of concurrent slots.
+//
+// Waiting requests are ordered by weighted fair queueing across priority classes
+// (stride scheduling on estimated work) and earliest-deadline-first inside a class.
+// Service time is estimated from the audio length and a running real-time factor,
+// so requests that can't meet their deadline are rejected before any decoding starts.
+class InferenceScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Held for the duration of one inference
+    class Slot {
+    public:
+        Slot(InferenceScheduler* scheduler, uint64_t id) : scheduler_(scheduler), id_(id) {}
+        Slot(Slot&& other) noexcept : scheduler_(other.scheduler_), id_(other.id_) { other.scheduler_ = nullptr; }
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+        Slot& operator=(Slot&&) = delete;
+        ~Slot();
+
+    private:
+        InferenceScheduler* scheduler_;
+        uint64_t id_;
+    };
+
+    InferenceScheduler(int slots, std::array<double, PRIORITY_CLASS_COUNT> weights, double initial_rtf);
+
+    // Cheap check before any CPU is spent on the request (upload conversion etc.); counts the
+    // request as submitted. audio_seconds may be 0 when the length isn't known yet.
+    void check_admission(PriorityClass cls, Clock::time_point deadline, double audio_seconds);
+
+    // Block until a slot is granted. Throws DeadlineError if the deadline can't be met,
+    // or CancelledError if the token is cancelled while the request is still queued.
+    // Counts the request as submitted unless check_admission already did.
+    Slot acquire(PriorityClass cls, Clock::time_point deadline, double audio_seconds, CancellationToken* cancel = nullptr,
+                 bool admission_checked = false);
+
+    // Per-class bookkeeping once a request is finished. Work that doesn't decode the whole
+    // clip (language detection) passes update_rtf=false, so it doesn't skew the estimate.
+    void record_completion(PriorityClass cls, double latency_seconds, double audio_seconds, double inference_seconds,
+                           bool update_rtf = true);
+    void record_failure(PriorityClass cls);
+    void record_cancellation(PriorityClass cls, CancelReason reason);
+
+    // Expected queueing delay for a new request of this class without a deadline
+    double estimated_wait(PriorityClass cls) const;
+
+    nlohmann::json metrics() const;
+
+private:
+    struct Ticket {
+        uint64_t id;
+        PriorityClass cls;
+        Clock::time_point deadline;
+        Clock::time_point enqueued;
+        double estimated_seconds;
+        bool granted = false;
+    };
+
+    struct Running {
+        uint64_t id;
+        Clock::time_point started;
+        double estimated_seconds;
+    };
+
+    struct ClassStats {
+        uint64_t submitted = 0;
+        uint64_t started = 0;
+        uint64_t completed = 0;
+        uint64_t rejected = 0;
+        uint64_t failed = 0;
+        uint64_t cancelled = 0;
+        double audio_seconds = 0.0;
+        double inference_seconds = 0.0;
+        double queue_wait_seconds = 0.0;
+        LatencyWindow latencies; // end-to-end latencies
+    };
+
+    double estimate_seconds_locked(double audio_seconds) const;
+    double estimate_wait_locked(PriorityClass cls, Clock::time_point deadline) const;
+    void reject_locked(PriorityClass cls, double estimated_wait, const std::string& reason);
+    void dispatch_locked();
+    void release(uint64_t id);
+
+    const int slots_;
+    const std::array<double, PRIORITY_CLASS_COUNT> weights_;
+    const Clock::time_point started_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::list<Ticket> queue_;
+    std::list<Running> running_;
+    std::array<double, PRIORITY_CLASS_COUNT> pass_{};
+    double virtual_time_ = 0.0;
+    std::array<ClassStats, PRIORITY_CLASS_COUNT> stats_;
+    uint64_t cancelled_disconnected_ = 0;
+    uint64_t cancelled_timeout_ = 0;
+    uint64_t cancelled_shutdown_ = 0;
+    uint64_t next_id_ = 1;
+    double rtf_;
+};
@@ -0,0 +1,94 @@
+#include "scratch_file.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// O_TMPFILE in dir, or mkstemp + unlink where the filesystem doesn't support it
+int open_unnamed_in(const std::string& dir) {
+#ifdef O_TMPFILE
+    int fd = open(dir.c_str(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0) {
+        return fd;
+    }
+#endif
+    std::string pattern = dir + "/whisper_XXXXXX";
+    std::vector<char> name(pattern.begin(), pattern.end());
+    name.push_back('\0');
+    int fd2 = mkostemp(name.data(), O_CLOEXEC);
+    if (fd2 >= 0) {
+        unlink(name.data());
+    }
+    return fd2;
+}
+
+} // namespace
+
+ScratchFile::ScratchFile(const std::string& label) {
+    const char* configured_dir = std::getenv("WHISPER_SCRATCH_DIR");
+    const bool has_dir = configured_dir != nullptr && *configured_dir != '\0';
+
+#ifdef MFD_CLOEXEC
+    if (!has_dir) {
+        fd_ = memfd_create(label.c_str(), MFD_CLOEXEC);
+    }
+#else
+    (void)label;
+#endif
+
+    if (fd_ < 0 && has_dir) {
+        fd_ = open_unnamed_in(configured_dir);
+    }
+    if (fd_ < 0) {
+        fd_ = open_unnamed_in("/dev/shm");
+    }
+    if (fd_ < 0) {
+        fd_ = open_unnamed_in("/tmp");
+    }
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("Failed to create scratch file: ") + std::strerror(errno));
+    }
+}
+
+ScratchFile::ScratchFile(ScratchFile&& other) noexcept : fd_(other.fd_) {
+    other.fd_ = -1;
+}
+
+ScratchFile::~ScratchFile() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+std::string ScratchFile::path() const {
+    return "/proc/self/fd/" + std::to_string(fd_);
+}
+
+void ScratchFile::write_all(const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = write(fd_, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("Failed to write scratch file: ") + std::strerror(errno));
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+size_t ScratchFile::size() const {
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        return 0;
+    }
+    return static_cast<size_t>(st.st_size);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Anonymous scratch file for intermediate audio (uploads, converted WAV).
+//
+// Backed by memfd_create by default; when WHISPER_SCRATCH_DIR is set (or memfd is
+// unavailable) an O_TMPFILE file in that tmpfs directory is used instead, falling back
+// to an immediately unlinked mkstemp file. The file never has a visible name, so
+// concurrent requests can't collide, and it is gone as soon as the object is destroyed,
+// on success and error paths alike.
+class ScratchFile {
+public:
+    // The label only shows up in /proc/<pid>/fd listings, it doesn't need to be unique
+    explicit ScratchFile(const std::string& label);
+    ~ScratchFile();
+
+    ScratchFile(ScratchFile&& other) noexcept;
+    ScratchFile(const ScratchFile&) = delete;
+    ScratchFile& operator=(const ScratchFile&) = delete;
+    ScratchFile& operator=(ScratchFile&&) = delete;
+
+    int fd() const { return fd_; }
+
+    // /proc/self/fd/N: opens this file in our process and in children that inherit fd()
+    std::string path() const;
+
+    void write_all(const void* data, size_t size);
+    size_t size() const;
+
+private:
+    int fd_ = -1;
+};
@@ -0,0 +1,180 @@
+#include "subprocess.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+// How often the child is checked for cancellation when it produces no output
+constexpr int POLL_INTERVAL_MS = 50;
+
+int wait_for_exit(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    return 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+} // namespace
+
+ProcessResult run_process(const std::vector<std::string>& args, const std::function<bool()>& should_cancel,
+                          const std::vector<int>& inherit_fds) {
+    if (args.empty()) {
+        throw std::invalid_argument("run_process: empty command");
+    }
+
+    int out_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+        throw std::runtime_error("pipe() failed");
+    }
+
+    // Build argv before forking; only async-signal-safe calls are allowed in the child
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        throw std::runtime_error("fork() failed");
+    }
+
+    if (pid == 0) {
+        dup2(out_pipe[1], STDOUT_FILENO);
+        dup2(out_pipe[1], STDERR_FILENO);
+        int devnull = open("/dev/null", O_RDONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDIN_FILENO);
+        }
+        for (int fd : inherit_fds) {
+            fcntl(fd, F_SETFD, 0);
+        }
+        // The server blocks its shutdown signals for sigwait; the exec'd child shouldn't inherit that
+        sigset_t unblocked;
+        sigemptyset(&unblocked);
+        sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(out_pipe[1]);
+
+    ProcessResult result;
+    char buffer[4096];
+    struct pollfd pfd = {out_pipe[0], POLLIN, 0};
+
+    while (true) {
+        if (should_cancel && should_cancel()) {
+            kill(pid, SIGKILL);
+            result.cancelled = true;
+            break;
+        }
+
+        int ready = poll(&pfd, 1, POLL_INTERVAL_MS);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        ssize_t n = read(out_pipe[0], buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            break; // EOF: the child closed its output and is exiting
+        }
+        result.output.append(buffer, static_cast<size_t>(n));
+    }
+
+    close(out_pipe[0]);
+    result.exit_code = wait_for_exit(pid);
+    return result;
+}
+
+ProcessReader::ProcessReader(const std::vector<std::string>& args, int stdin_fd) {
+    if (args.empty()) {
+        throw std::invalid_argument("ProcessReader: empty command");
+    }
+
+    int out_pipe[2];
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+        throw std::runtime_error("pipe() failed");
+    }
+
+    std::vector<char*> argv;
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        throw std::runtime_error("fork() failed");
+    }
+
+    if (pid == 0) {
+        dup2(out_pipe[1], STDOUT_FILENO);
+        if (stdin_fd != STDIN_FILENO) {
+            dup2(stdin_fd, STDIN_FILENO);
+        }
+        sigset_t unblocked;
+        sigemptyset(&unblocked);
+        sigprocmask(SIG_SETMASK, &unblocked, nullptr);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(out_pipe[1]);
+    pid_ = pid;
+    out_fd_ = out_pipe[0];
+}
+
+ProcessReader::~ProcessReader() {
+    if (pid_ > 0) {
+        kill(pid_, SIGKILL);
+        wait();
+    }
+}
+
+size_t ProcessReader::read(char* buffer, size_t size) {
+    while (true) {
+        ssize_t n = ::read(out_fd_, buffer, size);
+        if (n >= 0) {
+            return static_cast<size_t>(n);
+        }
+        if (errno != EINTR) {
+            throw std::runtime_error(std::string("read() from child failed: ") + std::strerror(errno));
+        }
+    }
+}
+
+int ProcessReader::wait() {
+    if (out_fd_ >= 0) {
+        close(out_fd_);
+        out_fd_ = -1;
+    }
+    if (pid_ <= 0) {
+        return -1;
+    }
+    const int exit_code = wait_for_exit(pid_);
+    pid_ = -1;
+    return exit_code;
+}
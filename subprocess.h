@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct ProcessResult {
+    int exit_code = -1;
+    std::string output;     // stdout and stderr, interleaved
+    bool cancelled = false; // killed because should_cancel returned true
+};
+
+// Run a program without a shell and capture its output.
+// While the child runs, should_cancel is polled every ~50 ms; when it returns true the
+// child is killed with SIGKILL and reaped before returning.
+// Descriptors in inherit_fds stay open in the child (everything else is close-on-exec),
+// so it can be handed /proc/self/fd/N paths.
+ProcessResult run_process(const std::vector<std::string>& args, const std::function<bool()>& should_cancel = nullptr,
+                          const std::vector<int>& inherit_fds = {});
+
+// A child whose stdout is read incrementally, for streaming through a filter such as ffmpeg.
+// Its stdin is stdin_fd (e.g. our own stdin, to hand it a pipeline's input) and its stderr
+// is ours. A child still running on destruction is killed and reaped.
+class ProcessReader {
+public:
+    ProcessReader(const std::vector<std::string>& args, int stdin_fd);
+    ~ProcessReader();
+    ProcessReader(const ProcessReader&) = delete;
+    ProcessReader& operator=(const ProcessReader&) = delete;
+
+    // Blocks until some output is available; 0 at end of output
+    size_t read(char* buffer, size_t size);
+
+    // Close the output and reap the child; returns its exit code
+    int wait();
+
+private:
+    int pid_ = -1;
+    int out_fd_ = -1;
+};
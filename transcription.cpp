@@ -0,0 +1,685 @@
+#include "transcription.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include "whisper.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Collect per-token or per-word timings of the last whisper_full run.
+// The result is columnar (one array per field, "segment" indexes into the segment list)
+// so long transcripts don't pay for one JSON object per word.
+json collect_timestamp_detail(struct whisper_context* ctx, struct whisper_state* state, TimestampDetail detail, bool use_dtw) {
+    std::vector<std::string> texts;
+    std::vector<double> starts;
+    std::vector<double> ends;
+    std::vector<float> probs;
+    std::vector<int> segment_ids;
+    std::vector<int> token_ids;
+
+    // Running word, flushed when the next token starts with a space or the segment ends
+    std::string word_text;
+    double word_start = 0.0;
+    double word_end = 0.0;
+    float word_prob_sum = 0.0f;
+    int word_tokens = 0;
+    int word_segment = 0;
+
+    auto flush_word = [&]() {
+        if (word_tokens == 0) return;
+        texts.push_back(word_text);
+        starts.push_back(word_start);
+        ends.push_back(word_end);
+        probs.push_back(word_prob_sum / word_tokens);
+        segment_ids.push_back(word_segment);
+        word_text.clear();
+        word_prob_sum = 0.0f;
+        word_tokens = 0;
+    };
+
+    const whisper_token token_eot = whisper_token_eot(ctx);
+    const int n_segments = whisper_full_n_segments_from_state(state);
+
+    for (int i = 0; i < n_segments; ++i) {
+        const int64_t seg_t1 = whisper_full_get_segment_t1_from_state(state, i);
+        const int n_tokens = whisper_full_n_tokens_from_state(state, i);
+
+        // Gather the text tokens of the segment first; special tokens carry no timing
+        std::vector<whisper_token_data> data;
+        std::vector<std::string> pieces;
+        for (int j = 0; j < n_tokens; ++j) {
+            whisper_token_data token = whisper_full_get_token_data_from_state(state, i, j);
+            if (token.id >= token_eot) continue;
+            data.push_back(token);
+            pieces.emplace_back(whisper_full_get_token_text_from_state(ctx, state, i, j));
+        }
+
+        for (size_t j = 0; j < data.size(); ++j) {
+            int64_t t0 = data[j].t0;
+            int64_t t1 = data[j].t1;
+            if (use_dtw) {
+                // DTW yields a single alignment point per token; a token lasts until the next one
+                t0 = data[j].t_dtw;
+                t1 = j + 1 < data.size() ? data[j + 1].t_dtw : seg_t1;
+            }
+
+            if (detail == TimestampDetail::Token) {
+                texts.push_back(pieces[j]);
+                starts.push_back(t0 / 100.0);
+                ends.push_back(t1 / 100.0);
+                probs.push_back(data[j].p);
+                segment_ids.push_back(i);
+                token_ids.push_back(data[j].id);
+                continue;
+            }
+
+            if (word_tokens > 0 && !pieces[j].empty() && pieces[j][0] == ' ') {
+                flush_word();
+            }
+            if (word_tokens == 0) {
+                word_start = t0 / 100.0;
+                word_segment = i;
+            }
+            word_text += pieces[j];
+            word_end = t1 / 100.0;
+            word_prob_sum += data[j].p;
+            word_tokens++;
+        }
+
+        flush_word();
+    }
+
+    json columns = {
+        {"text", texts},
+        {"start", starts},
+        {"end", ends},
+        {"probability", probs},
+        {"segment", segment_ids}
+    };
+    if (detail == TimestampDetail::Token) {
+        columns["id"] = token_ids;
+    }
+    return columns;
+}
+
+// Top-k language probabilities as returned by whisper_lang_auto_detect
+json language_probabilities(const std::vector<float>& probs, int lang_id, int top_k) {
+    std::vector<int> ids(probs.size());
+    for (size_t i = 0; i < ids.size(); ++i) ids[i] = static_cast<int>(i);
+    top_k = std::min(top_k, static_cast<int>(ids.size()));
+    std::partial_sort(ids.begin(), ids.begin() + top_k, ids.end(),
+                      [&probs](int a, int b) { return probs[a] > probs[b]; });
+
+    json top = json::array();
+    for (int i = 0; i < top_k; ++i) {
+        top.push_back({{"language", whisper_lang_str(ids[i])}, {"probability", probs[ids[i]]}});
+    }
+    return {
+        {"detected", whisper_lang_str(lang_id)},
+        {"probabilities", top}
+    };
+}
+
+// One decoded segment in the response format
+json segment_json(struct whisper_state* state, int i) {
+    const int64_t t0 = whisper_full_get_segment_t0_from_state(state, i);
+    const int64_t t1 = whisper_full_get_segment_t1_from_state(state, i);
+
+    // Convert timestamps to seconds
+    double time_start = t0 / 100.0;
+    double time_end = t1 / 100.0;
+
+    const char* text = whisper_full_get_segment_text_from_state(state, i);
+
+    return {
+        {"timeStart", time_start},
+        {"timeEnd", time_end},
+        {"text", std::string(text)}
+    };
+}
+
+// Mel frames (10 ms) in one encoder window, and the least audio worth decoding (as whisper_full)
+const int WINDOW_FRAMES = WHISPER_CHUNK_SIZE * 100;
+const int MIN_DECODE_FRAMES = 100;
+
+// Whisper's max_initial_ts: the first segment starts within the first second of a window
+const int MAX_INITIAL_TIMESTAMP = 50;
+
+// One decoder task (transcribe or translate) in the shared-encoder path of transcribe_audio
+struct SharedPass {
+    bool translate = false;
+    std::vector<whisper_token> past;   // prompt of the next window: tenant prompt, then earlier text
+    json segments = json::array();
+};
+
+// Logits of the last token passed to the previous whisper_decode_with_state call
+const float* last_logits(struct whisper_context* ctx, struct whisper_state* state, int n_tokens) {
+    return whisper_get_logits_from_state(state) + static_cast<size_t>(n_tokens - 1) * whisper_n_vocab(ctx);
+}
+
+// Language of the window whose encoder output the state holds; the same computation as
+// whisper_lang_auto_detect, minus its own encoder pass
+int detect_language_from_encoder(struct whisper_context* ctx, struct whisper_state* state, int n_threads,
+                                 std::vector<float>& probs) {
+    const whisper_token sot = whisper_token_sot(ctx);
+    if (whisper_decode_with_state(ctx, state, &sot, 1, 0, n_threads) != 0) {
+        return -1;
+    }
+    const float* logits = last_logits(ctx, state, 1);
+
+    int best = 0;
+    float max_logit = -INFINITY;
+    for (size_t i = 0; i < probs.size(); ++i) {
+        probs[i] = logits[whisper_token_lang(ctx, static_cast<int>(i))];
+        if (probs[i] > max_logit) {
+            max_logit = probs[i];
+            best = static_cast<int>(i);
+        }
+    }
+    float sum = 0.0f;
+    for (float& p : probs) {
+        p = std::exp(p - max_logit);
+        sum += p;
+    }
+    for (float& p : probs) {
+        p /= sum;
+    }
+    return best;
+}
+
+// Decoder prompt of a window: the pass's earlier context, then language and task
+std::vector<whisper_token> window_prompt(struct whisper_context* ctx, const SharedPass& pass, int lang_id) {
+    std::vector<whisper_token> prompt;
+    if (!pass.past.empty()) {
+        const size_t n_take = std::min(pass.past.size(), static_cast<size_t>(whisper_n_text_ctx(ctx) / 2));
+        prompt.push_back(whisper_token_prev(ctx));
+        prompt.insert(prompt.end(), pass.past.end() - n_take, pass.past.end());
+    }
+    prompt.push_back(whisper_token_sot(ctx));
+    prompt.push_back(whisper_token_lang(ctx, lang_id));
+    prompt.push_back(pass.translate ? whisper_token_translate(ctx) : whisper_token_transcribe(ctx));
+    return prompt;
+}
+
+// Greedy decode (temperature 0) of the window whose encoder output the state holds, with
+// whisper's timestamp rules: segments open and close with timestamps that never go back.
+// Returns the sampled tokens without the end token.
+std::vector<whisper_token> decode_window(struct whisper_context* ctx, struct whisper_state* state, int n_threads,
+                                         const std::vector<whisper_token>& prompt, const TenantContext* context,
+                                         CancellationToken* cancel) {
+    const int n_vocab = whisper_n_vocab(ctx);
+    const whisper_token eot = whisper_token_eot(ctx);
+    const whisper_token beg = whisper_token_beg(ctx);
+    const int n_text_ctx = whisper_n_text_ctx(ctx);
+    const int max_tokens = std::min(n_text_ctx / 2, n_text_ctx - static_cast<int>(prompt.size()) - 1);
+
+    if (whisper_decode_with_state(ctx, state, prompt.data(), static_cast<int>(prompt.size()), 0, n_threads) != 0) {
+        throw std::runtime_error("Failed to decode audio");
+    }
+    int n_past = static_cast<int>(prompt.size());
+    const float* output = last_logits(ctx, state, n_past);
+
+    std::vector<whisper_token> tokens;
+    std::vector<float> logits(n_vocab);
+    whisper_token last_timestamp = -1;
+    while (static_cast<int>(tokens.size()) < max_tokens) {
+        if (cancel != nullptr) {
+            cancel->throw_if_cancelled();
+        }
+        logits.assign(output, output + n_vocab);
+        auto suppress = [&logits](int from, int to) {
+            for (int id = std::max(from, 0); id < to; ++id) {
+                logits[id] = -INFINITY;
+            }
+        };
+
+        if (context != nullptr) {
+            for (whisper_token token : context->bias_tokens) {
+                if (token >= 0 && token < n_vocab) {
+                    logits[token] += context->bias;
+                }
+            }
+        }
+
+        // Special tokens other than the end token and the timestamps are never sampled
+        suppress(eot + 1, beg);
+
+        const bool last_was_timestamp = !tokens.empty() && tokens.back() >= beg;
+        const bool penultimate_was_timestamp = tokens.size() < 2 || tokens[tokens.size() - 2] >= beg;
+        if (tokens.empty()) {
+            // The window starts with the start time of its first segment
+            suppress(0, beg);
+            suppress(beg + MAX_INITIAL_TIMESTAMP + 1, n_vocab);
+        } else if (last_was_timestamp && penultimate_was_timestamp) {
+            // A segment was just opened: text follows
+            suppress(beg, n_vocab);
+        } else if (last_was_timestamp) {
+            // A segment was just closed: the next one opens, or the window ends
+            suppress(0, eot);
+        }
+
+        // Timestamps never go back, and a segment can't end where it started
+        if (last_timestamp >= 0) {
+            suppress(beg, last_was_timestamp && !penultimate_was_timestamp ? last_timestamp : last_timestamp + 1);
+        }
+
+        // A timestamp is due when all of them together are more likely than any text token
+        const float max_text = *std::max_element(logits.begin(), logits.begin() + beg);
+        const float max_timestamp = *std::max_element(logits.begin() + beg, logits.end());
+        if (max_timestamp > -INFINITY) {
+            float sum = 0.0f;
+            for (int id = beg; id < n_vocab; ++id) {
+                sum += std::exp(logits[id] - max_timestamp);
+            }
+            if (max_timestamp + std::log(sum) > max_text) {
+                suppress(0, beg);
+            }
+        }
+
+        const whisper_token token = static_cast<whisper_token>(std::max_element(logits.begin(), logits.end()) - logits.begin());
+        if (token == eot) {
+            break;
+        }
+        tokens.push_back(token);
+        if (token >= beg) {
+            last_timestamp = token;
+        }
+
+        if (whisper_decode_with_state(ctx, state, &token, 1, n_past, n_threads) != 0) {
+            throw std::runtime_error("Failed to decode audio");
+        }
+        n_past++;
+        output = last_logits(ctx, state, 1);
+    }
+    return tokens;
+}
+
+// Segments of one decoded window starting at window_start (in mel frames). consumed is set to
+// how much of the window they cover: a segment left open by the end of the window is dropped
+// and decoded again from its start in the next window, as whisper_full does.
+json window_segments(struct whisper_context* ctx, const std::vector<whisper_token>& tokens, int window_start,
+                     int window_frames, int& consumed) {
+    const whisper_token beg = whisper_token_beg(ctx);
+    auto segment = [window_start](int t0, int t1, const std::string& text) {
+        return json{
+            {"timeStart", (window_start + t0) / 100.0},
+            {"timeEnd", (window_start + t1) / 100.0},
+            {"text", text}
+        };
+    };
+
+    json segments = json::array();
+    std::string text;
+    int t0 = -1;
+    for (whisper_token token : tokens) {
+        if (token < beg) {
+            text += whisper_token_to_str(ctx, token);
+            continue;
+        }
+        const int t = 2 * (token - beg);
+        if (t0 >= 0 && !text.empty()) {
+            segments.push_back(segment(t0, t, text));
+            text.clear();
+            t0 = -1;
+        } else {
+            t0 = t;
+        }
+    }
+
+    consumed = window_frames;
+    if (!text.empty()) {
+        if (!segments.empty() && t0 > 0) {
+            consumed = t0;
+        } else {
+            segments.push_back(segment(std::max(t0, 0), window_frames, text));
+        }
+    } else if (t0 > 0) {
+        // Ended on a segment that was opened but has no text yet
+        consumed = t0;
+    }
+    consumed = std::min(consumed, window_frames);
+    return segments;
+}
+
+// Whether transcribe_audio decodes every output from one encoder pass per window: more than one
+// output needs the encoder, and nothing is asked for that only whisper_full provides (word and
+// token timings, beam search, a reduced encoder context or its segment-shaping settings)
+bool shares_encoder(const TranscribeOptions& options) {
+    const int passes = (options.transcribe ? 1 : 0) + (options.translate ? 1 : 0);
+    const bool needs_language = options.detect_language || options.language == "auto";
+    if (passes == 0 || passes + (needs_language ? 1 : 0) < 2) {
+        return false;
+    }
+    const DecodeProfile& profile = options.profile;
+    return options.timestamps == TimestampDetail::None && !profile.beam_search && !profile.audio_ctx &&
+           !profile.single_segment.value_or(false) && profile.max_len.value_or(0) == 0 &&
+           profile.max_tokens.value_or(0) == 0;
+}
+
+// The shared-encoder path of transcribe_audio, on the mel already held by the state: each window
+// is encoded once, and the language detection and every decoder pass read that encoder output
+json transcribe_shared(struct whisper_context* ctx, struct whisper_state* state, int n_threads,
+                       const TranscribeOptions& options, bool keep_context, CancellationToken* cancel) {
+    const int n_frames = whisper_n_len_from_state(state);
+
+    std::vector<SharedPass> passes;
+    if (options.transcribe) passes.push_back(SharedPass{false, {}, json::array()});
+    if (options.translate) passes.push_back(SharedPass{true, {}, json::array()});
+    if (options.context) {
+        for (auto& pass : passes) {
+            pass.past = options.context->prompt_tokens;
+        }
+    }
+
+    auto encode = [&](int seek) {
+        if (cancel != nullptr) {
+            cancel->throw_if_cancelled();
+        }
+        if (whisper_encode_with_state(ctx, state, seek, n_threads) != 0) {
+            throw std::runtime_error("Failed to encode audio");
+        }
+    };
+
+    json result = json::object();
+    int lang_id = whisper_lang_id(options.language.c_str());
+    bool encoded = false;   // whether the state holds the encoder output of the window at seek
+    if (options.detect_language || options.language == "auto") {
+        encode(0);
+        encoded = true;
+        std::vector<float> probs(whisper_lang_max_id() + 1, 0.0f);
+        lang_id = detect_language_from_encoder(ctx, state, n_threads, probs);
+        if (lang_id < 0) {
+            throw std::runtime_error("Failed to detect language");
+        }
+        if (options.detect_language) {
+            result["language"] = language_probabilities(probs, lang_id, LANGUAGE_TOP_K);
+        }
+    }
+
+    int seek = 0;
+    while (seek + MIN_DECODE_FRAMES < n_frames) {
+        if (!encoded) {
+            encode(seek);
+        }
+        encoded = false;
+
+        const int window_frames = std::min(WINDOW_FRAMES, n_frames - seek);
+        int consumed = window_frames;
+        for (size_t i = 0; i < passes.size(); ++i) {
+            SharedPass& pass = passes[i];
+            const std::vector<whisper_token> tokens =
+                decode_window(ctx, state, n_threads, window_prompt(ctx, pass, lang_id), options.context.get(), cancel);
+
+            int pass_consumed = 0;
+            const json segments = window_segments(ctx, tokens, seek, window_frames, pass_consumed);
+            if (i == 0) {
+                consumed = pass_consumed;
+            }
+            for (const json& segment : segments) {
+                // Later passes follow the first one's windows; what it left over is decoded again
+                if (i > 0 && segment["timeStart"].get<double>() >= (seek + consumed) / 100.0) {
+                    break;
+                }
+                if (!pass.translate && options.on_segment) {
+                    try {
+                        options.on_segment(segment);
+                    } catch (const std::exception& e) {
+                        std::cerr << "Segment callback failed: " << e.what() << std::endl;
+                    }
+                }
+                pass.segments.push_back(segment);
+            }
+            if (keep_context) {
+                pass.past.insert(pass.past.end(), tokens.begin(), tokens.end());
+            }
+        }
+        seek += std::max(consumed, 1);
+    }
+
+    for (const auto& pass : passes) {
+        if (pass.translate) {
+            result["translation"] = {{"segments", pass.segments}};
+        } else {
+            result["segments"] = pass.segments;
+        }
+    }
+    return result;
+}
+
+// Segments (and optional word/token timings) of the last whisper_full run on a state
+json collect_result(struct whisper_context* ctx, struct whisper_state* state, TimestampDetail detail, bool use_dtw) {
+    json segments = json::array();
+
+    // Get the number of segments
+    const int n_segments = whisper_full_n_segments_from_state(state);
+
+    for (int i = 0; i < n_segments; ++i) {
+        segments.push_back(segment_json(state, i));
+    }
+
+    json result = {{"segments", segments}};
+    if (detail == TimestampDetail::Word) {
+        result["words"] = collect_timestamp_detail(ctx, state, detail, use_dtw);
+    } else if (detail == TimestampDetail::Token) {
+        result["tokens"] = collect_timestamp_detail(ctx, state, detail, use_dtw);
+    }
+    return result;
+}
+
+// Two seconds of tones over low noise: enough to run a full encoder window and a few
+// decoder steps without depending on any audio file being present
+std::vector<float> synthetic_clip() {
+    std::vector<float> clip(2 * WHISPER_SAMPLE_RATE);
+    uint32_t noise = 12345;
+    for (size_t i = 0; i < clip.size(); ++i) {
+        const double t = static_cast<double>(i) / WHISPER_SAMPLE_RATE;
+        noise = noise * 1664525u + 1013904223u;
+        clip[i] = static_cast<float>(0.2 * std::sin(2 * M_PI * 220.0 * t) + 0.1 * std::sin(2 * M_PI * 440.0 * t) +
+                                     0.01 * (static_cast<double>(noise) / UINT32_MAX - 0.5));
+    }
+    return clip;
+}
+
+} // namespace
+
+TimestampDetail parse_timestamp_detail(const std::string& value) {
+    if (value.empty() || value == "segment" || value == "none") return TimestampDetail::None;
+    if (value == "word" || value == "words") return TimestampDetail::Word;
+    if (value == "token" || value == "tokens") return TimestampDetail::Token;
+    throw std::invalid_argument("Unknown timestamps granularity: " + value);
+}
+
+void parse_outputs(const std::string& value, TranscribeOptions& options) {
+    if (value.empty()) {
+        return;
+    }
+
+    options.transcribe = false;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t end = value.find(',', start);
+        if (end == std::string::npos) end = value.size();
+        const std::string output = value.substr(start, end - start);
+
+        if (output == "transcribe") options.transcribe = true;
+        else if (output == "translate") options.translate = true;
+        else if (output == "language") options.detect_language = true;
+        else throw std::invalid_argument("Unknown output: " + output);
+
+        start = end + 1;
+    }
+}
+
+json transcribe_audio(WhisperModel& model, const std::vector<float>& samples, const TranscribeOptions& options,
+                      CancellationToken* cancel) {
+    struct whisper_context* ctx = model.context();
+    const int n_threads = model.n_threads();
+
+    if (options.needs_multilingual() && !whisper_is_multilingual(ctx)) {
+        throw std::invalid_argument("The loaded model is English-only; translation and language detection need a multilingual model");
+    }
+
+    // Each concurrent inference decodes into its own state; the weights are shared
+    WhisperModel::StateLease state = model.acquire_state();
+
+    // Set full parameters
+    whisper_full_params full_params = make_full_params(options.profile);
+
+    // whisper_full leaves a reduced encoder context set on the state, where direct encoder
+    // calls (language detection, shared passes) of later requests would pick it up
+    if (full_params.audio_ctx > 0) {
+        state.discard();
+    }
+    // The engine is embedded in other processes; their stdout isn't ours to write to
+    full_params.print_realtime = false;
+    full_params.print_progress = false;
+    full_params.translate = false;
+    full_params.n_threads = n_threads;
+    full_params.offset_ms = 0;
+
+    // Token timings are computed inside the same decode pass, only when asked for
+    full_params.token_timestamps = options.timestamps != TimestampDetail::None;
+
+    // Tenant prompt tokens were tokenized once and are shared across requests
+    apply_tenant_context(full_params, options.context.get());
+
+    // Stop decoding as soon as the request is cancelled: before each encoder window
+    // and between graph nodes
+    if (cancel != nullptr) {
+        full_params.encoder_begin_callback = [](struct whisper_context*, struct whisper_state*, void* user_data) {
+            return !static_cast<CancellationToken*>(user_data)->cancelled();
+        };
+        full_params.encoder_begin_callback_user_data = cancel;
+        full_params.abort_callback = [](void* user_data) {
+            return static_cast<CancellationToken*>(user_data)->cancelled();
+        };
+        full_params.abort_callback_user_data = cancel;
+    }
+
+    // Mel spectrogram once, shared by every pass below
+    if (whisper_pcm_to_mel_with_state(ctx, state.get(), samples.data(), static_cast<int>(samples.size()), n_threads) != 0) {
+        throw std::runtime_error("Failed to compute mel spectrogram");
+    }
+
+    if (shares_encoder(options)) {
+        return transcribe_shared(ctx, state.get(), n_threads, options, !full_params.no_context, cancel);
+    }
+
+    json result = json::object();
+
+    // Detect the language once and pin it for the decoder passes, so they don't each re-detect
+    std::string language = options.language;
+    if (options.detect_language || language == "auto") {
+        std::vector<float> probs(whisper_lang_max_id() + 1, 0.0f);
+        const int lang_id = whisper_lang_auto_detect_with_state(ctx, state.get(), 0, n_threads, probs.data());
+        if (lang_id < 0) {
+            throw std::runtime_error("Failed to detect language");
+        }
+        language = whisper_lang_str(lang_id);
+        if (options.detect_language) {
+            result["language"] = language_probabilities(probs, lang_id, LANGUAGE_TOP_K);
+        }
+    }
+    full_params.language = language.c_str();
+
+    // Runs whisper_full on the mel already held by the state (no samples passed); the
+    // encoder runs again inside it, which is what the shared path above avoids
+    auto run_pass = [&](bool translate) {
+        if (cancel != nullptr) {
+            cancel->throw_if_cancelled();
+        }
+
+        full_params.translate = translate;
+
+        // Stream transcribe-pass segments as whisper finalizes them
+        full_params.new_segment_callback = nullptr;
+        if (!translate && options.on_segment) {
+            full_params.new_segment_callback = [](struct whisper_context*, struct whisper_state* st, int n_new, void* user_data) {
+                const auto& on_segment = *static_cast<const std::function<void(const json&)>*>(user_data);
+                const int n_segments = whisper_full_n_segments_from_state(st);
+                for (int i = n_segments - n_new; i < n_segments; ++i) {
+                    // Exceptions must not unwind through whisper.cpp's C frames
+                    try {
+                        on_segment(segment_json(st, i));
+                    } catch (const std::exception& e) {
+                        std::cerr << "Segment callback failed: " << e.what() << std::endl;
+                    }
+                }
+            };
+            full_params.new_segment_callback_user_data = const_cast<std::function<void(const json&)>*>(&options.on_segment);
+        }
+
+        const int status = whisper_full_with_state(ctx, state.get(), full_params, nullptr, 0);
+
+        // An aborted encoder pass still returns success with partial segments
+        if (cancel != nullptr) {
+            cancel->throw_if_cancelled();
+        }
+        if (status != 0) {
+            throw std::runtime_error("Failed to process audio");
+        }
+        return collect_result(ctx, state.get(), options.timestamps, model.dtw_enabled());
+    };
+
+    if (options.transcribe) {
+        result.update(run_pass(false));
+    }
+    if (options.translate) {
+        result["translation"] = run_pass(true);
+    }
+
+    return result;
+}
+
+json detect_language(WhisperModel& model, const std::vector<float>& samples, int top_k) {
+    struct whisper_context* ctx = model.context();
+    const int n_threads = model.n_threads();
+
+    WhisperModel::StateLease state = model.acquire_state();
+
+    const int n_samples = std::min(static_cast<int>(samples.size()), WHISPER_SAMPLE_RATE * WHISPER_CHUNK_SIZE);
+    if (whisper_pcm_to_mel_with_state(ctx, state.get(), samples.data(), n_samples, n_threads) != 0) {
+        throw std::runtime_error("Failed to compute mel spectrogram");
+    }
+
+    std::vector<float> probs(whisper_lang_max_id() + 1, 0.0f);
+    const int lang_id = whisper_lang_auto_detect_with_state(ctx, state.get(), 0, n_threads, probs.data());
+    if (lang_id < 0) {
+        throw std::runtime_error("Failed to detect language");
+    }
+    return language_probabilities(probs, lang_id, top_k);
+}
+
+void warm_up_model(WhisperModel& model, int max_threads, bool tune) {
+    const std::vector<float> clip = synthetic_clip();
+    transcribe_audio(model, clip);
+    if (!tune) {
+        return;
+    }
+
+    std::vector<int> candidates;
+    for (int n = max_threads >= 4 ? 2 : 1; n < max_threads; n *= 2) {
+        candidates.push_back(n);
+    }
+    candidates.push_back(max_threads);
+
+    int best_threads = model.n_threads();
+    double best_time = 0.0;
+    for (int n : candidates) {
+        model.set_n_threads(n);
+        auto start = std::chrono::steady_clock::now();
+        transcribe_audio(model, clip);
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cerr << "Warm-up with " << n << " threads: " << elapsed << " seconds" << std::endl;
+        if (best_time == 0.0 || elapsed < best_time) {
+            best_time = elapsed;
+            best_threads = n;
+        }
+    }
+    model.set_n_threads(best_threads);
+}
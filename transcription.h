@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nlohmann/json.hpp"
+#include "cancellation.h"
+#include "context_profiles.h"
+#include "decode_profiles.h"
+#include "whisper_model.h"
+
+// Number of languages reported by language detection
+const int LANGUAGE_TOP_K = 5;
+
+// Granularity of the optional timing detail returned next to the segments
+enum class TimestampDetail {
+    None,   // segment-level timeStart/timeEnd only
+    Word,   // per-word start/end/probability
+    Token   // per-token start/end/probability
+};
+
+// Throws std::invalid_argument for unknown names; empty selects None
+TimestampDetail parse_timestamp_detail(const std::string& value);
+
+// Per-request decoding options
+struct TranscribeOptions {
+    TimestampDetail timestamps = TimestampDetail::None;
+
+    // Cached prompt and vocabulary bias of the requesting tenant, if it has a profile
+    std::shared_ptr<const TenantContext> context;
+
+    // Sampling strategy, fallback and audio_ctx settings; defaults to whisper's
+    DecodeProfile profile;
+
+    // Spoken language, or "auto" to detect it
+    std::string language = "en";
+
+    // Outputs produced from a single decode of the upload and a single mel spectrogram,
+    // and where possible from a single encoder pass per window (see transcribe_audio)
+    bool transcribe = true;
+    bool translate = false;
+    bool detect_language = false;
+
+    // Called from inside whisper_full with each segment of the transcribe pass as soon as it
+    // is decoded, for streaming. Must not throw.
+    std::function<void(const nlohmann::json&)> on_segment;
+
+    // Whether the options need a multilingual model
+    bool needs_multilingual() const {
+        return translate || detect_language || language != "en";
+    }
+};
+
+// Parse a comma separated list of outputs: transcribe, translate, language
+void parse_outputs(const std::string& value, TranscribeOptions& options);
+
+// Function to transcribe audio using Whisper.
+//
+// All requested outputs share one whisper_state and one mel spectrogram. When more than one
+// output needs the encoder (transcript and translation, or either with language detection),
+// each 30 s window is encoded once and the detection and both decoder passes read that
+// encoder output, decoding greedily at temperature 0. Word/token timings, beam search and the
+// profile settings only whisper_full supports take one whisper_full pass per output instead,
+// each encoding the audio again.
+nlohmann::json transcribe_audio(WhisperModel& model, const std::vector<float>& samples, const TranscribeOptions& options = {},
+                                CancellationToken* cancel = nullptr);
+
+// Identify the spoken language from the first 30 s window only: one mel spectrogram
+// and one encoder pass, no decoding of the transcript.
+nlohmann::json detect_language(WhisperModel& model, const std::vector<float>& samples, int top_k);
+
+// Warm the model on a synthetic clip, then time it at each candidate thread count and
+// keep the fastest. The first run pays for page faults and cold caches and isn't counted.
+// With tune=false the current thread count is kept and only the warm-up run happens.
+void warm_up_model(WhisperModel& model, int max_threads, bool tune);
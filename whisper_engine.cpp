@@ -0,0 +1,205 @@
+#include "whisper_engine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "engine.h"
+
+using json = nlohmann::json;
+
+struct whisper_engine {
+    std::unique_ptr<WhisperEngine> engine;
+};
+
+struct whisper_engine_result {
+    json result;
+    std::vector<double> starts;
+    std::vector<double> ends;
+    std::vector<std::string> texts;
+    std::string dump;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+TranscribeOptions request_options(WhisperEngine& engine, const std::shared_ptr<WhisperModel>& model,
+                                  const whisper_engine_request& request) {
+    TranscribeOptions options = engine.options(model, request.profile != nullptr ? request.profile : "",
+                                               request.tenant != nullptr ? request.tenant : "");
+    if (request.language != nullptr) {
+        const std::string language = request.language;
+        if (language != "auto" && whisper_lang_id(language.c_str()) < 0) {
+            throw std::invalid_argument("Unknown language: " + language);
+        }
+        options.language = language;
+    }
+    switch (request.timestamps) {
+        case WHISPER_ENGINE_TIMESTAMPS_WORD: options.timestamps = TimestampDetail::Word; break;
+        case WHISPER_ENGINE_TIMESTAMPS_TOKEN: options.timestamps = TimestampDetail::Token; break;
+        default: options.timestamps = TimestampDetail::None; break;
+    }
+    if (request.translate) {
+        options.transcribe = false;
+        options.translate = true;
+    }
+    return options;
+}
+
+PriorityClass request_priority(const whisper_engine_request& request) {
+    switch (request.priority) {
+        case WHISPER_ENGINE_PRIORITY_INTERACTIVE: return PriorityClass::Interactive;
+        case WHISPER_ENGINE_PRIORITY_BATCH: return PriorityClass::Batch;
+        default: return PriorityClass::Standard;
+    }
+}
+
+InferenceScheduler::Clock::time_point request_deadline(const whisper_engine_request& request) {
+    if (request.timeout_ms <= 0) {
+        return InferenceScheduler::Clock::time_point::max();
+    }
+    return InferenceScheduler::Clock::now() + std::chrono::milliseconds(request.timeout_ms);
+}
+
+// Runs one transcription with the request's options and deadline; NULL on failure
+template <typename Transcribe>
+whisper_engine_result* run(whisper_engine* engine, const whisper_engine_request* request, Transcribe transcribe) {
+    try {
+        const whisper_engine_request defaults = whisper_engine_default_request();
+        const whisper_engine_request& req = request != nullptr ? *request : defaults;
+        WhisperEngine::Request run_request;
+        run_request.priority = request_priority(req);
+        run_request.deadline = request_deadline(req);
+        CancellationToken cancel(nullptr, run_request.deadline);
+        run_request.cancel = &cancel;
+
+        // The options' tenant context is tokenized for this generation, so the request runs on it
+        // even if the engine is reloaded meanwhile
+        run_request.model = engine->engine->model();
+
+        auto result = std::make_unique<whisper_engine_result>();
+        result->result = transcribe(*engine->engine, request_options(*engine->engine, run_request.model, req), run_request);
+
+        // Translation-only requests carry their segments under "translation"
+        const json& segments = result->result.contains("segments") ? result->result["segments"]
+                                                                     : result->result["translation"]["segments"];
+        for (const json& segment : segments) {
+            result->starts.push_back(segment["timeStart"]);
+            result->ends.push_back(segment["timeEnd"]);
+            result->texts.push_back(segment["text"]);
+        }
+        return result.release();
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return nullptr;
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+whisper_engine_config whisper_engine_default_config(void) {
+    whisper_engine_config config = {};
+    config.inference_slots = 1;
+    config.warm_up = 1;
+    return config;
+}
+
+whisper_engine_request whisper_engine_default_request(void) {
+    whisper_engine_request request = {};
+    request.priority = WHISPER_ENGINE_PRIORITY_STANDARD;
+    return request;
+}
+
+whisper_engine* whisper_engine_init(const whisper_engine_config* config) {
+    try {
+        const whisper_engine_config defaults = whisper_engine_default_config();
+        const whisper_engine_config& c = config != nullptr ? *config : defaults;
+
+        WhisperEngine::Config engine_config;
+        if (c.model_path != nullptr) engine_config.model_path = c.model_path;
+        if (c.decode_profiles_path != nullptr) engine_config.decode_profiles_path = c.decode_profiles_path;
+        if (c.context_profiles_path != nullptr) engine_config.context_profiles_path = c.context_profiles_path;
+        if (c.default_profile != nullptr) engine_config.default_profile = c.default_profile;
+        engine_config.inference_slots = std::max(1, c.inference_slots);
+        engine_config.n_threads = c.n_threads;
+        engine_config.warm_up = c.warm_up != 0;
+
+        auto engine = std::make_unique<whisper_engine>();
+        engine->engine = std::make_unique<WhisperEngine>(engine_config);
+        engine->engine->set_model(engine->engine->load_model());
+        return engine.release();
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return nullptr;
+    }
+}
+
+void whisper_engine_free(whisper_engine* engine) {
+    delete engine;
+}
+
+int whisper_engine_reload(whisper_engine* engine, const char* model_path) {
+    try {
+        const std::shared_ptr<WhisperModel> current = engine->engine->model();
+        const std::string path = model_path != nullptr ? model_path : (current ? current->path() : "");
+        // Same as the service: the new generation keeps the current thread count
+        engine->engine->set_model(engine->engine->load_model(path, current ? current->n_threads() : 0));
+        return 0;
+    } catch (const std::exception& e) {
+        last_error = e.what();
+        return -1;
+    }
+}
+
+whisper_engine_result* whisper_engine_transcribe_pcm(whisper_engine* engine, const float* samples, size_t n_samples,
+                                                     const whisper_engine_request* request) {
+    return run(engine, request, [samples, n_samples](WhisperEngine& e, const TranscribeOptions& options,
+                                                     const WhisperEngine::Request& run_request) {
+        return e.transcribe(std::vector<float>(samples, samples + n_samples), options, run_request);
+    });
+}
+
+whisper_engine_result* whisper_engine_transcribe_file(whisper_engine* engine, const char* path,
+                                                      const whisper_engine_request* request) {
+    return run(engine, request, [path](WhisperEngine& e, const TranscribeOptions& options,
+                                       const WhisperEngine::Request& run_request) {
+        return e.transcribe_file(path, options, run_request);
+    });
+}
+
+int whisper_engine_result_n_segments(const whisper_engine_result* result) {
+    return static_cast<int>(result->texts.size());
+}
+
+double whisper_engine_result_segment_start(const whisper_engine_result* result, int i) {
+    return i >= 0 && i < whisper_engine_result_n_segments(result) ? result->starts[i] : 0.0;
+}
+
+double whisper_engine_result_segment_end(const whisper_engine_result* result, int i) {
+    return i >= 0 && i < whisper_engine_result_n_segments(result) ? result->ends[i] : 0.0;
+}
+
+const char* whisper_engine_result_segment_text(const whisper_engine_result* result, int i) {
+    return i >= 0 && i < whisper_engine_result_n_segments(result) ? result->texts[i].c_str() : "";
+}
+
+const char* whisper_engine_result_json(whisper_engine_result* result) {
+    if (result->dump.empty()) {
+        result->dump = result->result.dump(-1, ' ', false, json::error_handler_t::replace);
+    }
+    return result->dump.c_str();
+}
+
+void whisper_engine_result_free(whisper_engine_result* result) {
+    delete result;
+}
+
+const char* whisper_engine_last_error(void) {
+    return last_error.c_str();
+}
+
+} // extern "C"
@@ -0,0 +1,87 @@
+#ifndef WHISPER_ENGINE_H
+#define WHISPER_ENGINE_H
+
+// C API of the transcription engine, for in-process callers in any language.
+//
+// Structs are passed by pointer and created from the *_default_* functions, so fields
+// can be added without breaking callers. Functions that fail return NULL (or a negative
+// value) and leave a message for whisper_engine_last_error on the calling thread.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct whisper_engine whisper_engine;
+typedef struct whisper_engine_result whisper_engine_result;
+
+enum whisper_engine_timestamps {
+    WHISPER_ENGINE_TIMESTAMPS_SEGMENT = 0,
+    WHISPER_ENGINE_TIMESTAMPS_WORD = 1,
+    WHISPER_ENGINE_TIMESTAMPS_TOKEN = 2
+};
+
+enum whisper_engine_priority {
+    WHISPER_ENGINE_PRIORITY_INTERACTIVE = 0,
+    WHISPER_ENGINE_PRIORITY_STANDARD = 1,
+    WHISPER_ENGINE_PRIORITY_BATCH = 2
+};
+
+struct whisper_engine_config {
+    const char* model_path;            // NULL: models/ggml-base.en.bin
+    int inference_slots;               // concurrent inferences
+    int n_threads;                     // threads per inference; 0 picks the fastest at load
+    int warm_up;                       // run a warm-up inference at load
+    const char* decode_profiles_path;  // NULL: models/decode_profiles.json
+    const char* context_profiles_path; // NULL: models/context_profiles.json
+    const char* default_profile;       // NULL: balanced
+};
+
+struct whisper_engine_request {
+    const char* language; // NULL: en; "auto" detects it
+    const char* profile;  // NULL: the default decode profile
+    const char* tenant;   // NULL: no tenant context
+    int timestamps;       // enum whisper_engine_timestamps
+    int translate;        // transcribe to English instead
+    int priority;         // enum whisper_engine_priority
+    int timeout_ms;       // 0: no deadline
+};
+
+struct whisper_engine_config whisper_engine_default_config(void);
+struct whisper_engine_request whisper_engine_default_request(void);
+
+// Loads (and warms up) the model; NULL on failure
+whisper_engine* whisper_engine_init(const struct whisper_engine_config* config);
+void whisper_engine_free(whisper_engine* engine);
+
+// Load a new model generation and swap it in; requests already running finish on the old one.
+// NULL keeps the current path. Returns 0 on success.
+int whisper_engine_reload(whisper_engine* engine, const char* model_path);
+
+// Transcribe 16 kHz mono float samples, or any file ffmpeg can read. Blocks until the
+// scheduler grants a slot and the transcription is done. NULL request uses the defaults.
+whisper_engine_result* whisper_engine_transcribe_pcm(whisper_engine* engine, const float* samples, size_t n_samples,
+                                                     const struct whisper_engine_request* request);
+whisper_engine_result* whisper_engine_transcribe_file(whisper_engine* engine, const char* path,
+                                                      const struct whisper_engine_request* request);
+
+// Segments of a result, times in seconds; strings are owned by the result
+int whisper_engine_result_n_segments(const whisper_engine_result* result);
+double whisper_engine_result_segment_start(const whisper_engine_result* result, int i);
+double whisper_engine_result_segment_end(const whisper_engine_result* result, int i);
+const char* whisper_engine_result_segment_text(const whisper_engine_result* result, int i);
+
+// The whole result as the service's JSON response (words/tokens, profile, timings)
+const char* whisper_engine_result_json(whisper_engine_result* result);
+
+void whisper_engine_result_free(whisper_engine_result* result);
+
+// Message of the last failed call on this thread
+const char* whisper_engine_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // WHISPER_ENGINE_H
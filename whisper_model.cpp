@@ -0,0 +1,95 @@
+#include "whisper_model.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+std::atomic<uint64_t> next_generation{1};
+
+} // namespace
+
+whisper_alignment_heads_preset dtw_preset_from_name(const std::string& name) {
+    static const std::map<std::string, whisper_alignment_heads_preset> presets = {
+        {"tiny.en", WHISPER_AHEADS_TINY_EN},   {"tiny", WHISPER_AHEADS_TINY},
+        {"base.en", WHISPER_AHEADS_BASE_EN},   {"base", WHISPER_AHEADS_BASE},
+        {"small.en", WHISPER_AHEADS_SMALL_EN}, {"small", WHISPER_AHEADS_SMALL},
+        {"medium.en", WHISPER_AHEADS_MEDIUM_EN}, {"medium", WHISPER_AHEADS_MEDIUM},
+        {"large-v1", WHISPER_AHEADS_LARGE_V1}, {"large-v2", WHISPER_AHEADS_LARGE_V2},
+        {"large-v3", WHISPER_AHEADS_LARGE_V3}, {"large-v3-turbo", WHISPER_AHEADS_LARGE_V3_TURBO},
+    };
+    auto it = presets.find(name);
+    return it != presets.end() ? it->second : WHISPER_AHEADS_NONE;
+}
+
+whisper_context_params make_context_params() {
+    whisper_context_params params = whisper_context_default_params();
+
+    const char* dtw = std::getenv("WHISPER_DTW");
+    if (dtw != nullptr && *dtw != '\0') {
+        whisper_alignment_heads_preset preset = dtw_preset_from_name(dtw);
+        if (preset == WHISPER_AHEADS_NONE) {
+            std::cerr << "Warning: unknown WHISPER_DTW preset '" << dtw << "', DTW timestamps disabled." << std::endl;
+        } else {
+            params.dtw_token_timestamps = true;
+            params.dtw_aheads_preset = preset;
+        }
+    }
+
+    return params;
+}
+
+WhisperModel::StateLease::~StateLease() {
+    if (state_ == nullptr) {
+        return;
+    }
+    if (discard_) {
+        whisper_free_state(state_);
+    } else {
+        model_->release_state(state_);
+    }
+}
+
+std::shared_ptr<WhisperModel> WhisperModel::load(const std::string& path, const whisper_context_params& params) {
+    // The states are created lazily per concurrent inference, so load the weights without one
+    whisper_context* ctx = whisper_init_from_file_with_params_no_state(path.c_str(), params);
+    if (ctx == nullptr) {
+        return nullptr;
+    }
+    return std::shared_ptr<WhisperModel>(new WhisperModel(path, ctx, params.dtw_token_timestamps));
+}
+
+WhisperModel::WhisperModel(std::string path, whisper_context* ctx, bool dtw_enabled)
+    : path_(std::move(path)), ctx_(ctx), dtw_enabled_(dtw_enabled), generation_(next_generation++) {}
+
+WhisperModel::~WhisperModel() {
+    for (whisper_state* state : idle_states_) {
+        whisper_free_state(state);
+    }
+    whisper_free(ctx_);
+}
+
+WhisperModel::StateLease WhisperModel::acquire_state() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_states_.empty()) {
+            whisper_state* state = idle_states_.back();
+            idle_states_.pop_back();
+            return StateLease(this, state);
+        }
+    }
+
+    whisper_state* state = whisper_init_state(ctx_);
+    if (state == nullptr) {
+        throw std::runtime_error("Failed to initialize whisper state");
+    }
+    return StateLease(this, state);
+}
+
+void WhisperModel::release_state(whisper_state* state) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_states_.push_back(state);
+}
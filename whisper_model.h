@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "whisper.h"
+
+// Map a WHISPER_DTW value (model name such as "base.en") to whisper's alignment head preset
+whisper_alignment_heads_preset dtw_preset_from_name(const std::string& name);
+
+// Context parameters shared by every transcription.
+// DTW token alignment is a context-level switch in whisper.cpp, so it is opt-in via WHISPER_DTW.
+whisper_context_params make_context_params();
+
+// A model loaded once per process. The weights live in a single whisper_context;
+// each concurrent inference borrows its own whisper_state from a small pool.
+class WhisperModel {
+public:
+    // Borrowed decoding state, returned to the pool on destruction
+    class StateLease {
+    public:
+        StateLease(WhisperModel* model, whisper_state* state) : model_(model), state_(state) {}
+        StateLease(StateLease&& other) noexcept : model_(other.model_), state_(other.state_), discard_(other.discard_) {
+            other.state_ = nullptr;
+        }
+        StateLease(const StateLease&) = delete;
+        StateLease& operator=(const StateLease&) = delete;
+        StateLease& operator=(StateLease&&) = delete;
+        ~StateLease();
+
+        whisper_state* get() const { return state_; }
+
+        // Free the state instead of returning it to the pool
+        void discard() { discard_ = true; }
+
+    private:
+        WhisperModel* model_;
+        whisper_state* state_;
+        bool discard_ = false;
+    };
+
+    // Returns nullptr when the model file can't be loaded
+    static std::shared_ptr<WhisperModel> load(const std::string& path, const whisper_context_params& params);
+
+    ~WhisperModel();
+    WhisperModel(const WhisperModel&) = delete;
+    WhisperModel& operator=(const WhisperModel&) = delete;
+
+    StateLease acquire_state();
+
+    whisper_context* context() const { return ctx_; }
+    const std::string& path() const { return path_; }
+    bool dtw_enabled() const { return dtw_enabled_; }
+
+    // Unique per load, even when a reload reads a new file from the same path. Data derived
+    // from the vocabulary (token ids) is cached per generation.
+    uint64_t generation() const { return generation_; }
+
+    // Threads per inference; picked at startup by benchmarking (WHISPER_THREADS overrides)
+    int n_threads() const { return n_threads_.load(std::memory_order_relaxed); }
+    void set_n_threads(int n_threads) { n_threads_.store(n_threads, std::memory_order_relaxed); }
+
+private:
+    WhisperModel(std::string path, whisper_context* ctx, bool dtw_enabled);
+    void release_state(whisper_state* state);
+
+    std::string path_;
+    whisper_context* ctx_;
+    bool dtw_enabled_;
+    const uint64_t generation_;
+    std::atomic<int> n_threads_{4};
+
+    std::mutex mutex_;
+    std::vector<whisper_state*> idle_states_;
+};